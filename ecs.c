@@ -1,9 +1,19 @@
+#define _POSIX_C_SOURCE 200112L // clock_gettime, posix_memalign
+
 #include "ecs.h"
 
 #include <alloca.h>
+#include <math.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ECS_KERNELS_X86
+#include <immintrin.h>
+#endif
 
 #define OUT_OF_MEMORY "out of memory"
 #define OUT_OF_BOUNDS "index out of bounds"
@@ -48,6 +58,27 @@ static inline void ecs_realloc(void **mem, size_t bytes) {
   }
 }
 
+#define CACHE_LINE 64
+#define FRONT_WRITER 0x80000000u // front_lock bit of the stepping thread
+#define READ_PREPARING 0x80000000u // readers bit of the first reader in
+
+// like ecs_realloc, but the memory starts on a cache line
+static inline void ecs_realloc_aligned(void **mem, size_t old_bytes,
+                                       size_t bytes) {
+  void *aligned = NULL;
+  if (bytes != 0) {
+    ECS_ENSURE(posix_memalign(&aligned, CACHE_LINE, bytes) == 0,
+               OUT_OF_MEMORY);
+  }
+
+  if (*mem != NULL) {
+    memcpy(aligned, *mem, old_bytes < bytes ? old_bytes : bytes);
+    free(*mem);
+  }
+
+  *mem = aligned;
+}
+
 typedef struct ecs_bucket_t {
   const void *key;
   uint32_t index;
@@ -73,13 +104,55 @@ struct ecs_type_t {
 
 struct ecs_signature_t {
   uint32_t count;
+  uint64_t read_only; // bit per component that is never written through views
   ecs_entity_t components[];
 };
 
-typedef struct ecs_system_t {
-  ecs_archetype_t *archetype;
+// archetypes matching a signature, with the column of every signature
+// component in each archetype resolved ahead of time
+struct ecs_query_t {
   ecs_signature_t *sig;
+  ecs_type_t *type;
+  uint32_t *component_sizes;
+  const ecs_field_t **component_fields;
+  uint32_t matched; // archetypes in the type index already tested
+  bool sorted;      // archetypes in type order instead of creation order
+  uint32_t count;
+  uint32_t capacity;
+  ecs_archetype_t **archetypes;
+  uint32_t *columns; // count rows of sig->count columns
+};
+
+typedef enum ecs_timing_t {
+  SYSTEM_EVERY_STEP,
+  SYSTEM_RATE_LIMITED, // at most once per step, once interval has passed
+  SYSTEM_FIXED,        // once per elapsed interval, catching up if behind
+} ecs_timing_t;
+
+typedef struct ecs_system_t {
+  ecs_query_t query;
   ecs_system_fn run;
+  bool chunk;
+  ecs_timing_t timing;
+  double interval;
+  double accumulator;
+  double since_run;
+  ecs_entity_t id;
+  bool enabled;
+  ecs_phase_t phase;
+  bool scheduled; // scratch flag for ecs_schedule_resolve
+  uint32_t after_count;
+  uint32_t after_capacity;
+  ecs_entity_t *after; // systems that must run before this one
+  bool sliced;
+  uint32_t max_rows;
+  uint32_t max_usec;
+  uint32_t cursor_archetype; // where the next sliced run picks up
+  uint32_t cursor_row;
+  uint32_t stride;
+  uint32_t stride_offset;
+  bool parallel;
+  uint32_t grain; // fewest rows handed to one parallel task
 } ecs_system_t;
 
 struct ecs_edge_t {
@@ -93,28 +166,99 @@ struct ecs_edge_list_t {
   ecs_edge_t *edges;
 };
 
+typedef struct ecs_component_info_t {
+  size_t size;
+  uint32_t field_count; // zero unless the component is split into fields
+  ecs_field_t *fields;
+  bool buffered; // keeps last step's values in a front buffer
+} ecs_component_info_t;
+
 typedef struct ecs_record_t {
   ecs_archetype_t *archetype;
   uint32_t row;
 } ecs_record_t;
 
+// a column packed away by ecs_compress_cold as runs of equal rows
+typedef struct ecs_cold_t {
+  bool compressed;
+  uint32_t size; // bytes per row
+  size_t packed_size;
+  unsigned char *packed;
+} ecs_cold_t;
+
 struct ecs_archetype_t {
   uint32_t capacity;
   uint32_t count;
   ecs_type_t *type;
   ecs_entity_t *entity_ids;
   void **components;
+  void **front; // NULL except for double buffered components
+  // registry change ticks of the last write to each column, and of the last
+  // time rows were added, removed or reordered
+  uint64_t *changed;
+  uint64_t rows_changed;
+  // checksum cache, valid while hashed_at is past the matching change tick
+  uint64_t *column_hash;
+  uint64_t *hashed_at;
+  uint64_t ids_hash;
+  uint64_t ids_hashed_at;
   ecs_edge_list_t *left_edges;
   ecs_edge_list_t *right_edges;
+  ecs_group_t *group; // owner of some columns, NULL if none
+  uint64_t *accesses;  // rows of each column that systems have run over
+  ecs_cold_t *cold;    // NULL until a column is compressed
+  uint32_t cold_count; // columns compressed right now
+};
+
+// entities spawned from one thread. ids come from a private range reserved in
+// batches, and the entities are only added to the registry at the next sync.
+struct ecs_spawner_t {
+  ecs_registry_t *registry;
+  ecs_entity_t next;
+  ecs_entity_t end;
+  uint32_t count;
+  uint32_t capacity;
+  ecs_entity_t *pending;
 };
 
+// component definitions and the id counter, shared by every registry created
+// with ecs_init_shared so that ids mean the same thing in all of them
+typedef struct ecs_definitions_t {
+  ecs_map_t *component_index; // <ecs_entity_t, ecs_component_info_t>
+  ecs_entity_t next_entity_id; // only touched atomically
+  uint32_t buffered_count;     // double buffered components
+  uint32_t refs;               // only touched atomically
+} ecs_definitions_t;
+
 struct ecs_registry_t {
+  ecs_definitions_t *definitions;
   ecs_map_t *entity_index;    // <ecs_entity_t, ecs_record_t>
-  ecs_map_t *component_index; // <ecs_entity_t, size_t>
+  ecs_map_t *component_index; // definitions->component_index
   ecs_map_t *system_index;    // <ecs_entity_t, ecs_system_t>
   ecs_map_t *type_index;      // <ecs_type_t *, ecs_archetype_t *>
   ecs_archetype_t *root;
-  ecs_entity_t next_entity_id;
+  uint32_t spawner_count;
+  uint32_t spawner_capacity;
+  ecs_spawner_t **spawners;
+  ecs_parallel_fn parallel;
+  void *parallel_ctx;
+  uint32_t workers;
+  bool deterministic;
+  bool schedule_dirty;
+  uint32_t schedule_count;
+  ecs_entity_t *schedule; // system ids in the order they run
+  uint32_t readers;       // threads in a read phase, only touched atomically
+  uint32_t front_lock;    // front readers, plus FRONT_WRITER, only atomically
+  uint64_t published;     // change tick of the last publish
+  uint64_t generation;    // publishes so far
+  uint64_t epoch;         // bumped by structural changes
+  uint64_t change_tick;   // bumped by every tracked write
+  uint32_t index_count;
+  uint32_t index_capacity;
+  ecs_index_t **indices;
+  uint32_t group_count;
+  uint32_t group_capacity;
+  ecs_group_t **groups;
 };
 
 #define MAP_LOAD_FACTOR 0.5
@@ -144,6 +288,27 @@ void ecs_map_free(ecs_map_t *map) {
   free(map);
 }
 
+// makes dst an exact copy of src, which must have the same key and item sizes
+static void ecs_map_copy(ecs_map_t *dst, const ecs_map_t *src) {
+  ECS_ASSERT(dst->key_size == src->key_size &&
+                 dst->item_size == src->item_size,
+             SOMETHING_TERRIBLE);
+  if (dst->load_capacity != src->load_capacity) {
+    size_t dense_len = src->load_capacity * MAP_LOAD_FACTOR + 1;
+    ecs_realloc((void **)&dst->sparse,
+                sizeof(ecs_bucket_t) * src->load_capacity);
+    ecs_realloc((void **)&dst->reverse_lookup, sizeof(uint32_t) * dense_len);
+    ecs_realloc(&dst->dense, src->item_size * dense_len);
+    dst->load_capacity = src->load_capacity;
+  }
+
+  memcpy(dst->sparse, src->sparse, sizeof(ecs_bucket_t) * src->load_capacity);
+  memcpy(dst->reverse_lookup, src->reverse_lookup,
+         sizeof(uint32_t) * (src->count + 1));
+  memcpy(dst->dense, src->dense, src->item_size * (src->count + 1));
+  dst->count = src->count;
+}
+
 static inline uint32_t next_pow_of_2(uint32_t n) {
   n--;
   n |= n >> 1;
@@ -241,7 +406,8 @@ void ecs_map_set(ecs_map_t *map, const void *key, const void *payload) {
   bucket->index = map->count + 1;
   void *loc = ECS_OFFSET(map->dense, map->item_size * bucket->index);
   memcpy(loc, payload, map->item_size);
-  map->reverse_lookup[bucket->index] = i % map->load_capacity;
+  // not i, which is past the tombstone when one was reused
+  map->reverse_lookup[bucket->index] = (uint32_t)(bucket - map->sparse);
   map->count++;
 
   if (map->count >= map->load_capacity * MAP_LOAD_FACTOR) {
@@ -284,11 +450,11 @@ void ecs_map_remove(ecs_map_t *map, const void *key) {
   map->count--;
 }
 
-void *ecs_map_values(ecs_map_t *map) {
+void *ecs_map_values(const ecs_map_t *map) {
   return ECS_OFFSET(map->dense, map->item_size);
 }
 
-uint32_t ecs_map_len(ecs_map_t *map) { return map->count; }
+uint32_t ecs_map_len(const ecs_map_t *map) { return map->count; }
 
 uint32_t ecs_map_hash_intptr(const void *key) {
   uintptr_t hashed = (uintptr_t)key;
@@ -392,6 +558,17 @@ ecs_type_t *ecs_type_copy(const ecs_type_t *from) {
 
 uint32_t ecs_type_len(const ecs_type_t *type) { return type->count; }
 
+// orders types by their elements, then by length
+static int ecs_type_compare(const ecs_type_t *a, const ecs_type_t *b) {
+  uint32_t len = a->count < b->count ? a->count : b->count;
+  for (uint32_t i = 0; i < len; i++) {
+    if (a->elements[i] != b->elements[i]) {
+      return a->elements[i] < b->elements[i] ? -1 : 1;
+    }
+  }
+  return (a->count > b->count) - (a->count < b->count);
+}
+
 bool ecs_type_equal(const ecs_type_t *a, const ecs_type_t *b) {
   if (a == b) {
     return true;
@@ -517,6 +694,7 @@ ecs_signature_t *ecs_signature_new(uint32_t count) {
   ecs_signature_t *sig =
       ecs_malloc(sizeof(ecs_signature_t) + (sizeof(ecs_entity_t) * count));
   sig->count = 0;
+  sig->read_only = 0;
   return sig;
 }
 
@@ -528,7 +706,12 @@ ecs_signature_t *ecs_signature_new_n(uint32_t count, ...) {
   va_start(args, count);
 
   for (uint32_t i = 0; i < count; i++) {
-    sig->components[i] = va_arg(args, ecs_entity_t);
+    ecs_entity_t component = va_arg(args, ecs_entity_t);
+    if (component & ECS_READ_ONLY) {
+      ECS_ENSURE(i < 64, "only the first 64 components can be read only");
+      sig->read_only |= (uint64_t)1 << i;
+    }
+    sig->components[i] = component & ~ECS_READ_ONLY;
   }
 
   va_end(args);
@@ -568,8 +751,9 @@ uint32_t ecs_edge_list_len(const ecs_edge_list_t *edge_list) {
 void ecs_edge_list_add(ecs_edge_list_t *edge_list, ecs_edge_t edge) {
   if (edge_list->count == edge_list->capacity) {
     const uint32_t growth = 2;
+    edge_list->capacity *= growth;
     ecs_realloc((void **)&edge_list->edges,
-                sizeof(ecs_edge_t) * edge_list->capacity * growth);
+                sizeof(ecs_edge_t) * edge_list->capacity);
   }
 
   edge_list->edges[edge_list->count++] = edge;
@@ -587,25 +771,217 @@ void ecs_edge_list_remove(ecs_edge_list_t *edge_list, ecs_entity_t component) {
     return;
   }
 
-  ecs_edge_t tmp = edges[i];
-  edges[i] = edges[edge_list->count];
-  edges[edge_list->count--] = tmp;
+  edges[i] = edges[--edge_list->count];
+}
+
+// component columns. regular components store one struct per row. split
+// components store each field as its own array, one after another, so field k
+// of a row lives at capacity * (size of fields before k) + row * (field size).
+// columns start on a cache line so parallel systems can split them cleanly.
+
+static inline size_t ecs_column_field_start(const ecs_component_info_t *info,
+                                            uint32_t field) {
+  size_t start = 0;
+  for (uint32_t k = 0; k < field; k++) {
+    start += info->fields[k].size;
+  }
+  return start;
+}
+
+static void ecs_column_copy(const ecs_component_info_t *info, void *dst,
+                            uint32_t dst_capacity, uint32_t dst_row,
+                            const void *src, uint32_t src_capacity,
+                            uint32_t src_row) {
+  if (info->field_count == 0) {
+    memcpy(ECS_OFFSET(dst, info->size * dst_row),
+           ECS_OFFSET(src, info->size * src_row), info->size);
+    return;
+  }
+
+  size_t start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    size_t size = info->fields[k].size;
+    memcpy(ECS_OFFSET(dst, dst_capacity * start + size * dst_row),
+           ECS_OFFSET(src, src_capacity * start + size * src_row), size);
+    start += size;
+  }
+}
+
+static void ecs_column_write(const ecs_component_info_t *info, void *column,
+                             uint32_t capacity, uint32_t row,
+                             const void *data) {
+  if (info->field_count == 0) {
+    memcpy(ECS_OFFSET(column, info->size * row), data, info->size);
+    return;
+  }
+
+  size_t start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    ecs_field_t field = info->fields[k];
+    memcpy(ECS_OFFSET(column, capacity * start + field.size * row),
+           ECS_OFFSET(data, field.offset), field.size);
+    start += field.size;
+  }
+}
+
+// copies one component value out of its column, gathering split fields
+static void ecs_column_read(const ecs_component_info_t *info,
+                            const void *column, uint32_t capacity,
+                            uint32_t row, void *out) {
+  if (info->field_count == 0) {
+    memcpy(out, ECS_OFFSET(column, info->size * row), info->size);
+    return;
+  }
+
+  memset(out, 0, info->size);
+  size_t start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    ecs_field_t field = info->fields[k];
+    memcpy(ECS_OFFSET(out, field.offset),
+           ECS_OFFSET(column, capacity * start + field.size * row),
+           field.size);
+    start += field.size;
+  }
+}
+
+static size_t ecs_column_row_size(const ecs_component_info_t *info) {
+  return info->field_count == 0
+             ? info->size
+             : ecs_column_field_start(info, info->field_count);
+}
+
+static void ecs_column_resize(const ecs_component_info_t *info, void **column,
+                              uint32_t old_capacity, uint32_t new_capacity) {
+  if (info->field_count == 0 || *column == NULL) {
+    ecs_realloc_aligned(column, ecs_column_row_size(info) * old_capacity,
+                        ecs_column_row_size(info) * new_capacity);
+    return;
+  }
+
+  // field arrays move when the capacity changes. walk them back to front when
+  // growing and front to back when shrinking so none are overwritten.
+  size_t row_size = ecs_column_row_size(info);
+  if (new_capacity > old_capacity) {
+    ecs_realloc_aligned(column, row_size * old_capacity,
+                        row_size * new_capacity);
+  }
+
+  for (uint32_t i = 0; i < info->field_count; i++) {
+    uint32_t k = new_capacity > old_capacity ? info->field_count - 1 - i : i;
+    size_t start = ecs_column_field_start(info, k);
+    uint32_t rows = old_capacity < new_capacity ? old_capacity : new_capacity;
+    memmove(ECS_OFFSET(*column, new_capacity * start),
+            ECS_OFFSET(*column, old_capacity * start),
+            info->fields[k].size * rows);
+  }
+
+  if (new_capacity < old_capacity) {
+    ecs_realloc_aligned(column, row_size * old_capacity,
+                        row_size * new_capacity);
+  }
 }
 
 #define ARCHETYPE_INITIAL_CAPACITY 16
 
+static inline bool ecs_column_cold(const ecs_archetype_t *archetype,
+                                   uint32_t column) {
+  return archetype->cold_count != 0 && archetype->cold[column].compressed;
+}
+
+// writes out the rows of a compressed column, returning how many there were
+static uint32_t ecs_cold_unpack(const ecs_cold_t *cold, void *array) {
+  const unsigned char *p = cold->packed, *end = p + cold->packed_size;
+  uint32_t row = 0;
+  while (p < end) {
+    uint32_t run;
+    memcpy(&run, p, sizeof(run));
+    p += sizeof(run);
+    for (uint32_t k = 0; k < run; k++) {
+      memcpy(ECS_OFFSET(array, (size_t)cold->size * row++), p, cold->size);
+    }
+    p += cold->size;
+  }
+  return row;
+}
+
+// one row of a compressed column, read in place. cold columns are mostly long
+// runs, so there are few to walk past.
+static const void *ecs_cold_row(const ecs_cold_t *cold, uint32_t row) {
+  const unsigned char *p = cold->packed, *end = p + cold->packed_size;
+  while (p < end) {
+    uint32_t run;
+    memcpy(&run, p, sizeof(run));
+    p += sizeof(run);
+    if (row < run) {
+      return p;
+    }
+    row -= run;
+    p += cold->size;
+  }
+  ECS_ABORT(OUT_OF_BOUNDS);
+}
+
+// compressed columns are unpacked by whatever changes them next. every path
+// that writes column data, or reads it in bulk without the helpers above, goes
+// through one of these first.
+static void ecs_column_inflate(ecs_archetype_t *archetype, uint32_t column) {
+  if (!ecs_column_cold(archetype, column)) {
+    return;
+  }
+
+  ecs_cold_t *cold = &archetype->cold[column];
+  void *array = NULL;
+  ecs_realloc_aligned(&array, 0, (size_t)cold->size * archetype->capacity);
+  uint32_t rows = ecs_cold_unpack(cold, array);
+  ECS_ASSERT(rows == archetype->count, SOMETHING_TERRIBLE);
+  (void)rows;
+
+  free(cold->packed);
+  *cold = (ecs_cold_t){0};
+  archetype->components[column] = array;
+  archetype->cold_count--;
+}
+
+static void ecs_archetype_inflate(ecs_archetype_t *archetype) {
+  uint32_t type_len = ecs_type_len(archetype->type);
+  for (uint32_t i = 0; i < type_len && archetype->cold_count > 0; i++) {
+    ecs_column_inflate(archetype, i);
+  }
+}
+
+// for functions that walk every archetype
+static void ecs_registry_inflate(const ecs_registry_t *registry) {
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype,
+                      { ecs_archetype_inflate(*archetype); });
+}
+
+// columns owned by a group live in its shared storage, see below
+static bool ecs_group_owns(const ecs_group_t *group, ecs_entity_t component);
+static void ecs_group_resize(ecs_group_t *group, ecs_archetype_t *archetype,
+                             uint32_t capacity);
+
 static void
 ecs_archetype_resize_component_array(ecs_archetype_t *archetype,
                                      const ecs_map_t *component_index,
-                                     uint32_t capacity) {
+                                     uint32_t old_capacity, uint32_t capacity) {
+  ecs_archetype_inflate(archetype);
   uint32_t i = 0;
   ECS_TYPE_EACH(archetype->type, e, {
-    size_t *component_size = ecs_map_get(component_index, (void *)e);
-    ECS_ASSERT(component_size != NULL, FAILED_LOOKUP);
-    ecs_realloc(&archetype->components[i], sizeof(*component_size) * capacity);
-    archetype->capacity = capacity;
+    ecs_component_info_t *info = ecs_map_get(component_index, (void *)e);
+    ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+    if (archetype->group == NULL || !ecs_group_owns(archetype->group, e)) {
+      ecs_column_resize(info, &archetype->components[i], old_capacity,
+                        capacity);
+    }
+    if (info->buffered) {
+      ecs_column_resize(info, &archetype->front[i], old_capacity, capacity);
+    }
     i++;
   });
+  if (archetype->group != NULL) {
+    ecs_group_resize(archetype->group, archetype, capacity);
+  }
+  archetype->capacity = capacity;
 }
 
 ecs_archetype_t *ecs_archetype_new(ecs_type_t *type,
@@ -621,10 +997,21 @@ ecs_archetype_t *ecs_archetype_new(ecs_type_t *type,
   archetype->entity_ids =
       ecs_malloc(sizeof(ecs_entity_t) * ARCHETYPE_INITIAL_CAPACITY);
   archetype->components = ecs_calloc(sizeof(void *), ecs_type_len(type));
+  archetype->front = ecs_calloc(sizeof(void *), ecs_type_len(type));
+  archetype->changed = ecs_calloc(sizeof(uint64_t), ecs_type_len(type));
+  archetype->rows_changed = 0;
+  archetype->column_hash = ecs_calloc(sizeof(uint64_t), ecs_type_len(type));
+  archetype->hashed_at = ecs_calloc(sizeof(uint64_t), ecs_type_len(type));
+  archetype->ids_hash = 0;
+  archetype->ids_hashed_at = 0;
   archetype->left_edges = ecs_edge_list_new();
   archetype->right_edges = ecs_edge_list_new();
+  archetype->group = NULL;
+  archetype->accesses = ecs_calloc(sizeof(uint64_t), ecs_type_len(type));
+  archetype->cold = NULL;
+  archetype->cold_count = 0;
 
-  ecs_archetype_resize_component_array(archetype, component_index,
+  ecs_archetype_resize_component_array(archetype, component_index, 0,
                                        ARCHETYPE_INITIAL_CAPACITY);
   ecs_map_set(type_index, type, &archetype);
 
@@ -635,8 +1022,18 @@ void ecs_archetype_free(ecs_archetype_t *archetype) {
   uint32_t component_count = ecs_type_len(archetype->type);
   for (uint32_t i = 0; i < component_count; i++) {
     free(archetype->components[i]);
+    free(archetype->front[i]);
+    if (archetype->cold != NULL) {
+      free(archetype->cold[i].packed);
+    }
   }
+  free(archetype->accesses);
+  free(archetype->cold);
   free(archetype->components);
+  free(archetype->front);
+  free(archetype->changed);
+  free(archetype->column_hash);
+  free(archetype->hashed_at);
 
   ecs_type_free(archetype->type);
   ecs_edge_list_free(archetype->left_edges);
@@ -645,16 +1042,30 @@ void ecs_archetype_free(ecs_archetype_t *archetype) {
   free(archetype);
 }
 
+// grows the archetype until it has room for rows entities
+static void ecs_archetype_reserve(ecs_archetype_t *archetype,
+                                  const ecs_map_t *component_index,
+                                  uint32_t rows) {
+  if (rows <= archetype->capacity) {
+    return;
+  }
+
+  const uint32_t growth = 2;
+  uint32_t capacity = archetype->capacity;
+  while (capacity < rows) {
+    capacity *= growth;
+  }
+
+  ecs_realloc((void **)&archetype->entity_ids,
+              sizeof(ecs_entity_t) * capacity);
+  ecs_archetype_resize_component_array(archetype, component_index,
+                                       archetype->capacity, capacity);
+}
+
 uint32_t ecs_archetype_add(ecs_archetype_t *archetype,
                            const ecs_map_t *component_index,
                            ecs_map_t *entity_index, ecs_entity_t e) {
-  if (archetype->count == archetype->capacity) {
-    const uint32_t growth = 2;
-    ecs_realloc((void **)&archetype->entity_ids,
-                sizeof(ecs_entity_t) * archetype->capacity * growth);
-    ecs_archetype_resize_component_array(archetype, component_index,
-                                         archetype->capacity * growth);
-  }
+  ecs_archetype_reserve(archetype, component_index, archetype->count + 1);
 
   archetype->entity_ids[archetype->count] = e;
   ecs_map_set(entity_index, (void *)e,
@@ -669,6 +1080,8 @@ uint32_t ecs_archetype_move_entity_right(ecs_archetype_t *left,
                                          ecs_map_t *entity_index,
                                          uint32_t left_row) {
   ECS_ASSERT(left_row < left->count, OUT_OF_BOUNDS);
+  ecs_archetype_inflate(left);
+  ecs_archetype_inflate(right);
   ecs_entity_t removed = left->entity_ids[left_row];
   left->entity_ids[left_row] = left->entity_ids[left->count - 1];
 
@@ -683,24 +1096,34 @@ uint32_t ecs_archetype_move_entity_right(ecs_archetype_t *left,
       j++;
     }
 
-    size_t *component_size = ecs_map_get(component_index, (void *)e);
-    ECS_ASSERT(component_size != NULL, FAILED_LOOKUP);
+    ecs_component_info_t *info = ecs_map_get(component_index, (void *)e);
+    ECS_ASSERT(info != NULL, FAILED_LOOKUP);
     void *left_component_array = left->components[i];
     void *right_component_array = right->components[j];
 
-    void *insert_component =
-        ECS_OFFSET(right_component_array, *component_size * right_row);
-    void *remove_component =
-        ECS_OFFSET(left_component_array, *component_size * left_row);
-    void *swap_component =
-        ECS_OFFSET(left_component_array, *component_size * (left->count - 1));
+    ecs_column_copy(info, right_component_array, right->capacity, right_row,
+                    left_component_array, left->capacity, left_row);
+    ecs_column_copy(info, left_component_array, left->capacity, left_row,
+                    left_component_array, left->capacity, left->count - 1);
 
-    memcpy(insert_component, remove_component, *component_size);
-    memcpy(remove_component, swap_component, *component_size);
+    if (info->buffered) {
+      ecs_column_copy(info, right->front[j], right->capacity, right_row,
+                      left->front[i], left->capacity, left_row);
+      ecs_column_copy(info, left->front[i], left->capacity, left_row,
+                      left->front[i], left->capacity, left->count - 1);
+    }
 
     i++;
   });
 
+  // the last entity filled the hole, so its record points at the new row
+  if (left_row != left->count - 1) {
+    ecs_record_t *moved =
+        ecs_map_get(entity_index, (void *)left->entity_ids[left_row]);
+    ECS_ASSERT(moved != NULL, FAILED_LOOKUP);
+    moved->row = left_row;
+  }
+
   left->count--;
   return right_row;
 }
@@ -812,6 +1235,7 @@ ecs_archetype_traverse_and_create(ecs_archetype_t *root, const ecs_type_t *type,
 
 #ifndef NDEBUG
 void ecs_archetype_inspect(ecs_archetype_t *archetype) {
+  ecs_archetype_inflate(archetype);
   printf("\narchetype: {\n");
   printf("  self: %p\n", (void *)archetype);
   printf("  capacity: %d\n", archetype->capacity);
@@ -859,165 +1283,4752 @@ void ecs_archetype_inspect(ecs_archetype_t *archetype) {
 }
 #endif
 
-ecs_registry_t *ecs_init(void) {
+static void ecs_query_init(ecs_query_t *query, ecs_signature_t *sig) {
+  query->sig = sig;
+  query->type = ecs_signature_as_type(sig);
+  query->component_sizes = ecs_malloc(sizeof(uint32_t) * sig->count);
+  query->component_fields = ecs_malloc(sizeof(ecs_field_t *) * sig->count);
+  query->matched = 0;
+  query->sorted = false;
+  query->count = 0;
+  query->capacity = 0;
+  query->archetypes = NULL;
+  query->columns = NULL;
+}
+
+static void ecs_query_fini(ecs_query_t *query) {
+  ecs_signature_free(query->sig);
+  ecs_type_free(query->type);
+  free(query->component_sizes);
+  free(query->component_fields);
+  free(query->archetypes);
+  free(query->columns);
+}
+
+static void ecs_query_add(ecs_query_t *query, ecs_archetype_t *archetype,
+                          const ecs_map_t *component_index) {
+  const ecs_signature_t *sig = query->sig;
+
+  if (query->count == query->capacity) {
+    query->capacity = query->capacity == 0 ? 4 : query->capacity * 2;
+    ecs_realloc((void **)&query->archetypes,
+                sizeof(ecs_archetype_t *) * query->capacity);
+    ecs_realloc((void **)&query->columns,
+                sizeof(uint32_t) * sig->count * query->capacity);
+  }
+
+  uint32_t index = query->count;
+  if (query->sorted) {
+    while (index > 0 &&
+           ecs_type_compare(query->archetypes[index - 1]->type,
+                            archetype->type) > 0) {
+      index--;
+    }
+    memmove(&query->archetypes[index + 1], &query->archetypes[index],
+            sizeof(ecs_archetype_t *) * (query->count - index));
+    memmove(&query->columns[(index + 1) * sig->count],
+            &query->columns[index * sig->count],
+            sizeof(uint32_t) * sig->count * (query->count - index));
+  }
+
+  uint32_t *columns = &query->columns[index * sig->count];
+  for (uint32_t i = 0; i < sig->count; i++) {
+    int32_t column = ecs_type_index_of(archetype->type, sig->components[i]);
+    ECS_ASSERT(column != -1, SOMETHING_TERRIBLE);
+    columns[i] = column;
+
+    if (query->count == 0) {
+      ecs_component_info_t *info =
+          ecs_map_get(component_index, (void *)sig->components[i]);
+      ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+      query->component_sizes[i] = info->size;
+      query->component_fields[i] = info->fields;
+    }
+  }
+
+  query->archetypes[index] = archetype;
+  query->count++;
+}
+
+// archetypes are never removed from the type index, so its values only grow.
+// only the archetypes created since the last update need to be tested.
+static void ecs_query_update(ecs_query_t *query, const ecs_map_t *type_index,
+                             const ecs_map_t *component_index) {
+  uint32_t archetype_count = ecs_map_len(type_index);
+  ecs_archetype_t **archetypes = ecs_map_values(type_index);
+
+  for (; query->matched < archetype_count; query->matched++) {
+    ecs_archetype_t *archetype = archetypes[query->matched];
+    if (ecs_type_is_superset(archetype->type, query->type)) {
+      ecs_query_add(query, archetype, component_index);
+    }
+  }
+}
+
+static inline ecs_view_t ecs_query_view(const ecs_query_t *query,
+                                        uint32_t index) {
+  ecs_archetype_t *archetype = query->archetypes[index];
+  uint32_t *columns = &query->columns[index * query->sig->count];
+  for (uint32_t j = 0; j < query->sig->count && archetype->cold_count != 0;
+       j++) {
+    ecs_column_inflate(archetype, columns[j]);
+  }
+  return (ecs_view_t){archetype->components, columns,
+                      query->component_sizes, query->component_fields,
+                      archetype->capacity, 0.0f};
+}
+
+// every function that changes the registry checks this first
+static inline void ecs_ensure_writable(const ecs_registry_t *registry) {
+  ECS_ENSURE(__atomic_load_n(&registry->readers, __ATOMIC_ACQUIRE) == 0,
+             "registry is in a read phase");
+}
+
+// structural changes move and reallocate the front buffers and rehash the
+// maps front readers walk, so they also wait for systems to finish
+static inline void ecs_ensure_structural(const ecs_registry_t *registry) {
+  ecs_ensure_writable(registry);
+  ECS_ENSURE(__atomic_load_n(&registry->front_lock, __ATOMIC_RELAXED) &
+                 FRONT_WRITER,
+             "structural changes cannot be made while systems run");
+}
+
+static ecs_registry_t *ecs_init_help(ecs_definitions_t *definitions) {
   ecs_registry_t *registry = ecs_malloc(sizeof(ecs_registry_t));
+  registry->definitions = definitions;
   registry->entity_index = ECS_MAP(intptr, ecs_entity_t, ecs_record_t, 16);
-  registry->component_index = ECS_MAP(intptr, ecs_entity_t, size_t, 8);
+  registry->component_index = definitions->component_index;
   registry->system_index = ECS_MAP(intptr, ecs_entity_t, ecs_system_t, 4);
   registry->type_index = ECS_MAP(type, ecs_type_t *, ecs_archetype_t *, 8);
 
   ecs_type_t *root_type = ecs_type_new(0);
   registry->root = ecs_archetype_new(root_type, registry->component_index,
                                      registry->type_index);
-  registry->next_entity_id = 1;
+  registry->readers = 0;
+  registry->front_lock = FRONT_WRITER;
+  registry->published = 0;
+  registry->generation = 0;
+  registry->epoch = 0;
+  registry->change_tick = 0;
+  registry->spawner_count = 0;
+  registry->spawner_capacity = 0;
+  registry->spawners = NULL;
+  registry->parallel = NULL;
+  registry->parallel_ctx = NULL;
+  registry->workers = 1;
+  registry->deterministic = false;
+  registry->schedule_dirty = false;
+  registry->schedule_count = 0;
+  registry->schedule = NULL;
+  registry->index_count = 0;
+  registry->index_capacity = 0;
+  registry->indices = NULL;
+  registry->group_count = 0;
+  registry->group_capacity = 0;
+  registry->groups = NULL;
   return registry;
 }
 
+ecs_registry_t *ecs_init(void) {
+  ecs_definitions_t *definitions = ecs_malloc(sizeof(ecs_definitions_t));
+  definitions->component_index =
+      ECS_MAP(intptr, ecs_entity_t, ecs_component_info_t, 8);
+  definitions->next_entity_id = 1;
+  definitions->buffered_count = 0;
+  definitions->refs = 1;
+  return ecs_init_help(definitions);
+}
+
+// a new, empty world that shares registry's component definitions and ids.
+// each world costs a few small maps and an empty root archetype.
+ecs_registry_t *ecs_init_shared(ecs_registry_t *registry) {
+  __atomic_add_fetch(&registry->definitions->refs, 1, __ATOMIC_RELAXED);
+  return ecs_init_help(registry->definitions);
+}
+
 void ecs_destroy(ecs_registry_t *registry) {
-  ECS_MAP_VALUES_EACH(registry->system_index, ecs_system_t, system,
-                      { ecs_signature_free(system->sig); });
+  ecs_ensure_structural(registry);
+  ECS_MAP_VALUES_EACH(registry->system_index, ecs_system_t, system, {
+    ecs_query_fini(&system->query);
+    free(system->after);
+  });
+  free(registry->schedule);
+  while (registry->group_count > 0) {
+    ecs_group_free(registry->groups[0]);
+  }
+  free(registry->groups);
   ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype,
                       { ecs_archetype_free(*archetype); });
+  for (uint32_t i = 0; i < registry->spawner_count; i++) {
+    free(registry->spawners[i]->pending);
+    free(registry->spawners[i]);
+  }
+  free(registry->spawners);
+  while (registry->index_count > 0) {
+    ecs_index_free(registry->indices[0]);
+  }
+  free(registry->indices);
   ecs_map_free(registry->type_index);
   ecs_map_free(registry->entity_index);
-  ecs_map_free(registry->component_index);
   ecs_map_free(registry->system_index);
-  free(registry);
-}
 
-ecs_entity_t ecs_entity(ecs_registry_t *registry) {
-  ecs_archetype_t *root = registry->root;
-  uint32_t row =
-      ecs_archetype_add(root, registry->component_index, registry->entity_index,
-                        registry->next_entity_id);
-  ecs_map_set(registry->entity_index, (void *)registry->next_entity_id,
-              &(ecs_record_t){root, row});
-  return registry->next_entity_id++;
+  ecs_definitions_t *definitions = registry->definitions;
+  if (__atomic_sub_fetch(&definitions->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    ECS_MAP_VALUES_EACH(definitions->component_index, ecs_component_info_t,
+                        info, { free(info->fields); });
+    ecs_map_free(definitions->component_index);
+    free(definitions);
+  }
+  free(registry);
 }
 
-ecs_entity_t ecs_component(ecs_registry_t *registry, size_t component_size) {
-  ecs_map_set(registry->component_index, (void *)registry->next_entity_id,
-              &(size_t){component_size});
-  return registry->next_entity_id++;
+// moves element from to position to, shifting the ones in between by one
+static void ecs_array_rotate(void *array, size_t size, uint32_t from,
+                             uint32_t to) {
+  void *tmp = alloca(size);
+  memcpy(tmp, ECS_OFFSET(array, size * from), size);
+  if (from < to) {
+    memmove(ECS_OFFSET(array, size * from),
+            ECS_OFFSET(array, size * (from + 1)), size * (to - from));
+  } else {
+    memmove(ECS_OFFSET(array, size * (to + 1)), ECS_OFFSET(array, size * to),
+            size * (from - to));
+  }
+  memcpy(ECS_OFFSET(array, size * to), tmp, size);
 }
 
-ecs_entity_t ecs_system(ecs_registry_t *registry, ecs_signature_t *signature,
-                        ecs_system_fn system) {
-  ecs_type_t *type = ecs_signature_as_type(signature);
-  ecs_archetype_t **maybe_archetype = ecs_map_get(registry->type_index, type);
-  ecs_archetype_t *archetype;
-
-  if (maybe_archetype == NULL) {
-    archetype = ecs_archetype_traverse_and_create(
-        registry->root, type, registry->component_index, registry->type_index);
-  } else {
-    archetype = *maybe_archetype;
-    ecs_type_free(type);
+static void ecs_column_rotate(const ecs_component_info_t *info, void *column,
+                              uint32_t capacity, uint32_t from, uint32_t to) {
+  if (info->field_count == 0) {
+    ecs_array_rotate(column, info->size, from, to);
+    return;
   }
 
-  ecs_map_set(registry->system_index, (void *)registry->next_entity_id,
-              &(ecs_system_t){archetype, signature, system});
-  return registry->next_entity_id++;
+  size_t start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    ecs_array_rotate(ECS_OFFSET(column, capacity * start),
+                     info->fields[k].size, from, to);
+    start += info->fields[k].size;
+  }
 }
 
-void ecs_attach(ecs_registry_t *registry, ecs_entity_t entity,
-                ecs_entity_t component) {
-  ecs_record_t *record = ecs_map_get(registry->entity_index, (void *)entity);
-
-  if (record == NULL) {
-    char err[255];
-    sprintf(err, "attaching component %lu to unknown entity %lu", component,
-            entity);
-    ECS_ABORT(err);
+// moves a row without changing the order of the others
+static void ecs_archetype_rotate(ecs_registry_t *registry,
+                                 ecs_archetype_t *archetype, uint32_t from,
+                                 uint32_t to) {
+  if (from == to) {
+    return;
   }
 
-  ecs_type_t *init_type = record->archetype->type;
-  ecs_type_t *fini_type = ecs_type_copy(init_type);
-  ecs_type_add(fini_type, component);
+  ecs_archetype_inflate(archetype);
+  uint32_t i = 0;
+  ECS_TYPE_EACH(archetype->type, e, {
+    ecs_component_info_t *info =
+        ecs_map_get(registry->component_index, (void *)e);
+    ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+    ecs_column_rotate(info, archetype->components[i], archetype->capacity, from,
+                      to);
+    if (info->buffered) {
+      ecs_column_rotate(info, archetype->front[i], archetype->capacity, from,
+                        to);
+    }
+    i++;
+  });
 
-  ecs_archetype_t **maybe_fini_archetype =
-      ecs_map_get(registry->type_index, fini_type);
-  ecs_archetype_t *fini_archetype;
+  ecs_array_rotate(archetype->entity_ids, sizeof(ecs_entity_t), from, to);
+  uint32_t first = from < to ? from : to;
+  uint32_t last = from < to ? to : from;
+  for (uint32_t row = first; row <= last; row++) {
+    ecs_record_t *record = ecs_map_get(registry->entity_index,
+                                       (void *)archetype->entity_ids[row]);
+    ECS_ASSERT(record != NULL, FAILED_LOOKUP);
+    record->row = row;
+  }
+}
 
-  if (maybe_fini_archetype == NULL) {
-    fini_archetype = ecs_archetype_insert_vertex(
-        registry->root, record->archetype, fini_type, component,
-        registry->component_index, registry->type_index);
-  } else {
-    ecs_type_free(fini_type);
-    fini_archetype = *maybe_fini_archetype;
+// deterministic registries keep rows sorted by entity id, so iteration order
+// depends on which entities exist and not on the order things happened in.
+// moves a newly added row into place and returns where it went.
+static uint32_t ecs_archetype_place(ecs_registry_t *registry,
+                                    ecs_archetype_t *archetype, uint32_t row) {
+  if (!registry->deterministic) {
+    return row;
   }
 
-  uint32_t new_row = ecs_archetype_move_entity_right(
-      record->archetype, fini_archetype, registry->component_index,
-      registry->entity_index, record->row);
-  ecs_map_set(registry->entity_index, (void *)entity,
-              &(ecs_record_t){fini_archetype, new_row});
+  ecs_entity_t entity = archetype->entity_ids[row];
+  uint32_t lo = 0, hi = row;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (archetype->entity_ids[mid] < entity) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  ecs_archetype_rotate(registry, archetype, row, lo);
+  return lo;
 }
 
-void ecs_set(ecs_registry_t *registry, ecs_entity_t entity,
-             ecs_entity_t component, const void *data) {
-  size_t *component_size =
-      ecs_map_get(registry->component_index, (void *)component);
-  ECS_ENSURE(component_size != NULL, FAILED_LOOKUP);
+// moves a row about to be removed to the end, so that filling its hole with
+// the last row does not reorder anything. returns the row's new index.
+static uint32_t ecs_archetype_unplace(ecs_registry_t *registry,
+                                      ecs_archetype_t *archetype,
+                                      uint32_t row) {
+  if (!registry->deterministic) {
+    return row;
+  }
 
-  ecs_record_t *record = ecs_map_get(registry->entity_index, (void *)entity);
-  ECS_ENSURE(record != NULL, FAILED_LOOKUP);
+  ecs_archetype_rotate(registry, archetype, row, archetype->count - 1);
+  return archetype->count - 1;
+}
 
-  int32_t column = ecs_type_index_of(record->archetype->type, component);
-  ECS_ENSURE(column != -1, OUT_OF_BOUNDS);
+// hands out count consecutive ids. safe to call from any thread.
+static inline ecs_entity_t ecs_reserve_ids(ecs_registry_t *registry,
+                                           uint32_t count) {
+  return __atomic_fetch_add(&registry->definitions->next_entity_id, count,
+                            __ATOMIC_RELAXED);
+}
 
-  void *component_array = record->archetype->components[column];
-  void *element = ECS_OFFSET(component_array, *component_size * record->row);
-  memcpy(element, data, *component_size);
+// change tracking. systems, query walks, ecs_set and structural changes
+// record a new tick on every column they may have written. writes through
+// pointers from ecs_get are reported with ecs_changed.
+static inline void ecs_archetype_touch_column(ecs_registry_t *registry,
+                                              ecs_archetype_t *archetype,
+                                              uint32_t column) {
+  archetype->changed[column] = ++registry->change_tick;
 }
 
-static void ecs_step_help(ecs_archetype_t *archetype,
-                          const ecs_map_t *component_index,
-                          const ecs_signature_t *sig, ecs_system_fn run) {
-  if (archetype == NULL) {
+// every column a query's views expose, as a walk over it may write them, save
+// those the signature reads only. readers promise not to write, and could not
+// share the tick if they did, so read phases are left alone. outside them the
+// registry is only const to say that walks change no structure.
+static void ecs_query_touch(const ecs_registry_t *registry,
+                            const ecs_query_t *query) {
+  if (__atomic_load_n(&registry->readers, __ATOMIC_ACQUIRE) != 0) {
     return;
   }
 
-  uint32_t signature_to_index[sig->count];
-  uint32_t component_sizes[sig->count];
-
-  for (uint32_t slow = 0; slow < sig->count; slow++) {
-    uint32_t type_len = ecs_type_len(archetype->type);
-    for (uint32_t fast = 0; fast < type_len; fast++) {
-      ecs_entity_t component = archetype->type->elements[fast];
-      if (component == sig->components[slow]) {
-        size_t *component_size =
-            ecs_map_get(component_index, (void *)component);
-        ECS_ENSURE(component_size != NULL, FAILED_LOOKUP);
-
-        component_sizes[slow] = *component_size;
-        signature_to_index[slow] = fast;
-        break;
+  ecs_registry_t *writable = (ecs_registry_t *)registry;
+  for (uint32_t i = 0; i < query->count; i++) {
+    if (query->archetypes[i]->count != 0) {
+      const uint32_t *columns = &query->columns[i * query->sig->count];
+      for (uint32_t j = 0; j < query->sig->count; j++) {
+        if (j >= 64 || !(query->sig->read_only & ((uint64_t)1 << j))) {
+          ecs_archetype_touch_column(writable, query->archetypes[i],
+                                     columns[j]);
+        }
       }
     }
   }
+}
 
-  ecs_view_t view = {archetype->components, signature_to_index,
-                     component_sizes};
-  for (uint32_t i = 0; i < archetype->count; i++) {
-    run(view, i);
+static void ecs_archetype_touch(ecs_registry_t *registry,
+                                ecs_archetype_t *archetype) {
+  uint64_t tick = ++registry->change_tick;
+  uint32_t len = ecs_type_len(archetype->type);
+  for (uint32_t i = 0; i < len; i++) {
+    archetype->changed[i] = tick;
   }
+  archetype->rows_changed = tick;
+}
 
-  ECS_EDGE_LIST_EACH(archetype->right_edges, edge, {
-    ecs_step_help(edge.archetype, component_index, sig, run);
+void ecs_changed(ecs_registry_t *registry, ecs_entity_t component) {
+  ecs_ensure_writable(registry);
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    int32_t column = ecs_type_index_of((*archetype)->type, component);
+    if (column != -1) {
+      ecs_archetype_touch_column(registry, *archetype, column);
+    }
   });
 }
 
-void ecs_step(ecs_registry_t *registry) {
+uint64_t ecs_change_tick(const ecs_registry_t *registry) {
+  return registry->change_tick;
+}
+
+static void ecs_entity_insert(ecs_registry_t *registry, ecs_entity_t entity) {
+  registry->epoch++;
+  ecs_archetype_touch(registry, registry->root);
+  ecs_archetype_t *root = registry->root;
+  uint32_t row = ecs_archetype_add(root, registry->component_index,
+                                   registry->entity_index, entity);
+  ecs_archetype_place(registry, root, row);
+}
+
+ecs_entity_t ecs_entity(ecs_registry_t *registry) {
+  ecs_ensure_structural(registry);
+  ecs_entity_t entity = ecs_reserve_ids(registry, 1);
+  ecs_entity_insert(registry, entity);
+  return entity;
+}
+
+#define SPAWNER_BATCH 64
+
+ecs_spawner_t *ecs_spawner(ecs_registry_t *registry) {
+  ecs_spawner_t *spawner = ecs_malloc(sizeof(ecs_spawner_t));
+  *spawner = (ecs_spawner_t){registry, 0, 0, 0, 0, NULL};
+
+  if (registry->spawner_count == registry->spawner_capacity) {
+    registry->spawner_capacity =
+        registry->spawner_capacity == 0 ? 4 : registry->spawner_capacity * 2;
+    ecs_realloc((void **)&registry->spawners,
+                sizeof(ecs_spawner_t *) * registry->spawner_capacity);
+  }
+  registry->spawners[registry->spawner_count++] = spawner;
+  return spawner;
+}
+
+ecs_entity_t ecs_spawn(ecs_spawner_t *spawner) {
+  if (spawner->next == spawner->end) {
+    spawner->next = ecs_reserve_ids(spawner->registry, SPAWNER_BATCH);
+    spawner->end = spawner->next + SPAWNER_BATCH;
+  }
+
+  if (spawner->count == spawner->capacity) {
+    spawner->capacity = spawner->capacity == 0 ? 16 : spawner->capacity * 2;
+    ecs_realloc((void **)&spawner->pending,
+                sizeof(ecs_entity_t) * spawner->capacity);
+  }
+
+  spawner->pending[spawner->count++] = spawner->next;
+  return spawner->next++;
+}
+
+void ecs_sync(ecs_registry_t *registry) {
+  ecs_ensure_structural(registry);
+  for (uint32_t i = 0; i < registry->spawner_count; i++) {
+    ecs_spawner_t *spawner = registry->spawners[i];
+    for (uint32_t j = 0; j < spawner->count; j++) {
+      ecs_entity_insert(registry, spawner->pending[j]);
+    }
+    spawner->count = 0;
+  }
+}
+
+ecs_entity_t ecs_component(ecs_registry_t *registry, size_t component_size) {
+  ecs_ensure_structural(registry);
+  ecs_entity_t component = ecs_reserve_ids(registry, 1);
+  ecs_map_set(registry->component_index, (void *)component,
+              &(ecs_component_info_t){component_size, 0, NULL, false});
+  return component;
+}
+
+void ecs_component_split(ecs_registry_t *registry, ecs_entity_t component,
+                         uint32_t field_count, const ecs_field_t *fields) {
+  ecs_ensure_structural(registry);
+  ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(info->field_count == 0, "component is already split");
+  ECS_ENSURE(field_count > 0, "split component needs at least one field");
+
+  // other worlds' archetypes are out of reach, so layouts are fixed once shared
+  ECS_ENSURE(registry->definitions->refs == 1,
+             "component must be split before worlds share it");
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    ECS_ENSURE(ecs_type_index_of((*archetype)->type, component) == -1,
+               "component must be split before it is attached");
+  });
   ECS_MAP_VALUES_EACH(registry->system_index, ecs_system_t, sys, {
-    ecs_step_help(sys->archetype, registry->component_index, sys->sig,
-                  sys->run);
+    ECS_ENSURE(!sys->parallel || !sys->chunk ||
+                   ecs_type_index_of(sys->query.type, component) == -1,
+               "parallel chunk systems cannot use split components");
   });
+
+  for (uint32_t i = 0; i < field_count; i++) {
+    ECS_ENSURE(fields[i].size > 0 &&
+                   fields[i].offset + fields[i].size <= info->size,
+               OUT_OF_BOUNDS);
+    for (uint32_t j = 0; j < i; j++) {
+      ECS_ENSURE(fields[i].offset + fields[i].size <= fields[j].offset ||
+                     fields[j].offset + fields[j].size <= fields[i].offset,
+                 "split component fields overlap");
+    }
+  }
+
+  info->fields = ecs_malloc(sizeof(ecs_field_t) * field_count);
+  memcpy(info->fields, fields, sizeof(ecs_field_t) * field_count);
+  info->field_count = field_count;
 }
 
-void *ecs_view(ecs_view_t view, uint32_t row, uint32_t column) {
+void ecs_component_buffered(ecs_registry_t *registry, ecs_entity_t component) {
+  ecs_ensure_structural(registry);
+  ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+
+  // other worlds' archetypes are out of reach, so layouts are fixed once shared
+  ECS_ENSURE(registry->definitions->refs == 1,
+             "component must be buffered before worlds share it");
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    ECS_ENSURE(ecs_type_index_of((*archetype)->type, component) == -1,
+               "component must be buffered before it is attached");
+  });
+
+  if (!info->buffered) {
+    info->buffered = true;
+    registry->definitions->buffered_count++;
+  }
+}
+
+ecs_query_t *ecs_query(ecs_registry_t *registry, ecs_signature_t *signature) {
+  ecs_query_t *query = ecs_malloc(sizeof(ecs_query_t));
+  ecs_query_init(query, signature);
+  query->sorted = registry->deterministic;
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  return query;
+}
+
+void ecs_query_free(ecs_query_t *query) {
+  ecs_query_fini(query);
+  free(query);
+}
+
+void ecs_query_each(const ecs_registry_t *registry, ecs_query_t *query,
+                    ecs_each_fn fn, void *ctx) {
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  ecs_query_touch(registry, query);
+  for (uint32_t i = 0; i < query->count; i++) {
+    uint32_t count = query->archetypes[i]->count;
+    if (count != 0) {
+      fn(ecs_query_view(query, i), count, ctx);
+    }
+  }
+}
+
+// like ecs_query_each, but over the front buffers. systems may be writing
+// every other column, so the signature can only name double buffered
+// components, and nothing but the caller's own query is written.
+void ecs_query_each_front(const ecs_registry_t *registry, ecs_query_t *query,
+                          ecs_each_fn fn, void *ctx) {
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  uint32_t sig_count = query->sig->count;
+  for (uint32_t i = 0; i < query->count; i++) {
+    const ecs_archetype_t *archetype = query->archetypes[i];
+    if (archetype->count == 0) {
+      continue;
+    }
+
+    uint32_t *columns = &query->columns[i * sig_count];
+    for (uint32_t j = 0; j < sig_count; j++) {
+      ECS_ENSURE(archetype->front[columns[j]] != NULL ||
+                     query->component_sizes[j] == 0,
+                 "front queries read double buffered components only");
+    }
+    fn((ecs_view_t){archetype->front, columns, query->component_sizes,
+                    query->component_fields, archetype->capacity, 0.0f},
+       archetype->count, ctx);
+  }
+}
+
+static ecs_entity_t ecs_system_add(ecs_registry_t *registry,
+                                   ecs_signature_t *signature,
+                                   ecs_system_fn system, bool chunk) {
+  ecs_ensure_writable(registry);
+  ecs_system_t sys = {.run = system,
+                      .chunk = chunk,
+                      .id = ecs_reserve_ids(registry, 1),
+                      .enabled = true,
+                      .phase = ECS_UPDATE,
+                      .stride = 1};
+  ecs_query_init(&sys.query, signature);
+  sys.query.sorted = registry->deterministic;
+  ecs_map_set(registry->system_index, (void *)sys.id, &sys);
+  registry->schedule_dirty = true;
+  return sys.id;
+}
+
+ecs_entity_t ecs_system(ecs_registry_t *registry, ecs_signature_t *signature,
+                        ecs_system_fn system) {
+  return ecs_system_add(registry, signature, system, false);
+}
+
+ecs_entity_t ecs_system_chunk(ecs_registry_t *registry,
+                              ecs_signature_t *signature,
+                              ecs_system_fn system) {
+  return ecs_system_add(registry, signature, system, true);
+}
+
+static void ecs_system_timing(ecs_registry_t *registry, ecs_entity_t system,
+                              ecs_timing_t timing, float interval,
+                              float phase) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(interval > 0.0f, "system interval must be positive");
+  ECS_ENSURE(phase >= 0.0f && phase < interval, OUT_OF_BOUNDS);
+
+  // the first run happens once interval + phase seconds have passed, so
+  // systems sharing an interval can be staggered across steps
+  sys->timing = timing;
+  sys->interval = interval;
+  sys->accumulator = -(double)phase;
+  sys->since_run = 0.0;
+}
+
+void ecs_system_interval(ecs_registry_t *registry, ecs_entity_t system,
+                         float interval, float phase) {
+  ecs_system_timing(registry, system, SYSTEM_RATE_LIMITED, interval, phase);
+}
+
+void ecs_system_fixed(ecs_registry_t *registry, ecs_entity_t system,
+                      float interval, float phase) {
+  ecs_system_timing(registry, system, SYSTEM_FIXED, interval, phase);
+}
+
+void ecs_system_enable(ecs_registry_t *registry, ecs_entity_t system) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  sys->enabled = true;
+}
+
+// disabled systems keep their place in the schedule and their matched
+// archetypes, and their interval timers are paused
+void ecs_system_disable(ecs_registry_t *registry, ecs_entity_t system) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  sys->enabled = false;
+}
+
+static void ecs_after_remove(ecs_system_t *sys, ecs_entity_t other) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < sys->after_count; i++) {
+    if (sys->after[i] != other) {
+      sys->after[kept++] = sys->after[i];
+    }
+  }
+  sys->after_count = kept;
+}
+
+// dropping a system from a valid schedule leaves a valid schedule, so the
+// remaining systems keep their order without being resolved again
+void ecs_system_remove(ecs_registry_t *registry, ecs_entity_t system) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ecs_query_fini(&sys->query);
+  free(sys->after);
+  ecs_map_remove(registry->system_index, (void *)system);
+
+  ECS_MAP_VALUES_EACH(registry->system_index, ecs_system_t, other,
+                      { ecs_after_remove(other, system); });
+
+  for (uint32_t i = 0; i < registry->schedule_count; i++) {
+    if (registry->schedule[i] == system) {
+      memmove(&registry->schedule[i], &registry->schedule[i + 1],
+              sizeof(ecs_entity_t) * (registry->schedule_count - i - 1));
+      registry->schedule_count--;
+      break;
+    }
+  }
+}
+
+// sliced systems process at most max_rows rows, or stop once max_usec
+// microseconds have passed, then continue from the same place next step. zero
+// means no limit.
+void ecs_system_budget(ecs_registry_t *registry, ecs_entity_t system,
+                       uint32_t max_rows, uint32_t max_usec) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(!sys->chunk, "chunk systems cannot be time sliced");
+  ECS_ENSURE(sys->stride == 1, "strided systems cannot be time sliced");
+  ECS_ENSURE(!sys->parallel, "parallel systems cannot be time sliced");
+  sys->sliced = max_rows != 0 || max_usec != 0;
+  sys->max_rows = max_rows;
+  sys->max_usec = max_usec;
+}
+
+// strided systems visit every stride-th row, starting one row later on each
+// run, so every row is visited once per stride runs
+void ecs_system_stride(ecs_registry_t *registry, ecs_entity_t system,
+                       uint32_t stride) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(stride > 0, OUT_OF_BOUNDS);
+  ECS_ENSURE(stride == 1 || !sys->chunk, "chunk systems cannot be strided");
+  ECS_ENSURE(!sys->sliced, "time sliced systems cannot be strided");
+  ECS_ENSURE(!sys->parallel, "parallel systems cannot be strided");
+  sys->stride = stride;
+  sys->stride_offset = 0;
+}
+
+void ecs_executor(ecs_registry_t *registry, ecs_parallel_fn parallel,
+                  void *ctx, uint32_t workers) {
+  ecs_ensure_writable(registry);
+  ECS_ENSURE(parallel == NULL || workers > 0, OUT_OF_BOUNDS);
+  registry->parallel = parallel;
+  registry->parallel_ctx = ctx;
+  registry->workers = parallel == NULL ? 1 : workers;
+}
+
+// parallel systems split each archetype into ranges of rows that are handed to
+// the registry's executor. a grain of zero picks a default.
+void ecs_system_parallel(ecs_registry_t *registry, ecs_entity_t system,
+                         uint32_t grain) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(!sys->sliced && sys->stride == 1,
+             "time sliced and strided systems cannot be parallel");
+  // chunk ranges are found by offsetting whole rows
+  for (uint32_t i = 0; sys->chunk && i < sys->query.sig->count; i++) {
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)sys->query.sig->components[i]);
+    ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+    ECS_ENSURE(info->field_count == 0,
+               "parallel chunk systems cannot use split components");
+  }
+  sys->parallel = true;
+  sys->grain = grain;
+}
+
+void ecs_system_phase(ecs_registry_t *registry, ecs_entity_t system,
+                      ecs_phase_t phase) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(phase < ECS_PHASE_COUNT, OUT_OF_BOUNDS);
+  sys->phase = phase;
+  registry->schedule_dirty = true;
+}
+
+void ecs_system_after(ecs_registry_t *registry, ecs_entity_t system,
+                      ecs_entity_t other) {
+  ecs_ensure_writable(registry);
+  ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)system);
+  ECS_ENSURE(sys != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(ecs_map_get(registry->system_index, (void *)other) != NULL,
+             FAILED_LOOKUP);
+  ECS_ENSURE(system != other, "system cannot run after itself");
+
+  if (sys->after_count == sys->after_capacity) {
+    sys->after_capacity =
+        sys->after_capacity == 0 ? 2 : sys->after_capacity * 2;
+    ecs_realloc((void **)&sys->after,
+                sizeof(ecs_entity_t) * sys->after_capacity);
+  }
+
+  sys->after[sys->after_count++] = other;
+  registry->schedule_dirty = true;
+}
+
+void ecs_system_before(ecs_registry_t *registry, ecs_entity_t system,
+                       ecs_entity_t other) {
+  ecs_system_after(registry, other, system);
+}
+
+static bool ecs_system_ready(const ecs_registry_t *registry,
+                             const ecs_system_t *sys) {
+  for (uint32_t i = 0; i < sys->after_count; i++) {
+    ecs_system_t *other =
+        ecs_map_get(registry->system_index, (void *)sys->after[i]);
+    ECS_ASSERT(other != NULL, FAILED_LOOKUP);
+    if (!other->scheduled) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// orders systems by phase, then by their before/after constraints, then by
+// the order they were registered in. runs only when systems or constraints
+// change, and ecs_step replays the result.
+static void ecs_schedule_resolve(ecs_registry_t *registry) {
+  uint32_t count = ecs_map_len(registry->system_index);
+  ecs_system_t *systems = ecs_map_values(registry->system_index);
+
+  ecs_realloc((void **)&registry->schedule, sizeof(ecs_entity_t) * count);
+  registry->schedule_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    systems[i].scheduled = false;
+  }
+
+  for (uint32_t n = 0; n < count; n++) {
+    ecs_system_t *next = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+      ecs_system_t *sys = &systems[i];
+      if (sys->scheduled || !ecs_system_ready(registry, sys)) {
+        continue;
+      }
+
+      if (next == NULL || sys->phase < next->phase ||
+          (sys->phase == next->phase && sys->id < next->id)) {
+        next = sys;
+      }
+    }
+
+    ECS_ENSURE(next != NULL, "system ordering constraints form a cycle");
+    if (n > 0) {
+      ecs_system_t *prev = ecs_map_get(registry->system_index,
+                                       (void *)registry->schedule[n - 1]);
+      ECS_ENSURE(prev->phase <= next->phase,
+                 "system ordering constraint contradicts system phases");
+    }
+
+    next->scheduled = true;
+    registry->schedule[registry->schedule_count++] = next->id;
+  }
+
+  registry->schedule_dirty = false;
+}
+
+// secondary indices follow ecs_attach and ecs_set as they happen, see below
+static void ecs_indices_begin(ecs_registry_t *registry);
+static void ecs_indices_attach(ecs_registry_t *registry,
+                               ecs_archetype_t *init_archetype,
+                               ecs_archetype_t *fini_archetype,
+                               ecs_entity_t entity, ecs_entity_t component,
+                               uint32_t row);
+static void ecs_indices_set(ecs_registry_t *registry,
+                            ecs_archetype_t *archetype, ecs_entity_t entity,
+                            ecs_entity_t component, uint32_t row);
+
+void ecs_attach(ecs_registry_t *registry, ecs_entity_t entity,
+                ecs_entity_t component) {
+  ecs_ensure_structural(registry);
+  ecs_indices_begin(registry);
+  ecs_record_t *record = ecs_map_get(registry->entity_index, (void *)entity);
+
+  if (record == NULL) {
+    char err[255];
+    sprintf(err, "attaching component %lu to unknown entity %lu", component,
+            entity);
+    ECS_ABORT(err);
+  }
+
+  ecs_type_t *init_type = record->archetype->type;
+  ecs_type_t *fini_type = ecs_type_copy(init_type);
+  ecs_type_add(fini_type, component);
+
+  ecs_archetype_t **maybe_fini_archetype =
+      ecs_map_get(registry->type_index, fini_type);
+  ecs_archetype_t *fini_archetype;
+
+  if (maybe_fini_archetype == NULL) {
+    fini_archetype = ecs_archetype_insert_vertex(
+        registry->root, record->archetype, fini_type, component,
+        registry->component_index, registry->type_index);
+  } else {
+    ecs_type_free(fini_type);
+    fini_archetype = *maybe_fini_archetype;
+  }
+
+  // record is stale once the entity index has been written to
+  ecs_archetype_t *init_archetype = record->archetype;
+  uint32_t old_row =
+      ecs_archetype_unplace(registry, init_archetype, record->row);
+  uint32_t new_row = ecs_archetype_move_entity_right(
+      init_archetype, fini_archetype, registry->component_index,
+      registry->entity_index, old_row);
+  ecs_map_set(registry->entity_index, (void *)entity,
+              &(ecs_record_t){fini_archetype, new_row});
+  new_row = ecs_archetype_place(registry, fini_archetype, new_row);
+  ecs_archetype_touch(registry, init_archetype);
+  ecs_archetype_touch(registry, fini_archetype);
+  ecs_indices_attach(registry, init_archetype, fini_archetype, entity,
+                     component, new_row);
+  registry->epoch++;
+}
+
+void ecs_set(ecs_registry_t *registry, ecs_entity_t entity,
+             ecs_entity_t component, const void *data) {
+  ecs_ensure_writable(registry);
+  ecs_indices_begin(registry);
+  ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+
+  ecs_record_t *record = ecs_map_get(registry->entity_index, (void *)entity);
+  ECS_ENSURE(record != NULL, FAILED_LOOKUP);
+
+  int32_t column = ecs_type_index_of(record->archetype->type, component);
+  ECS_ENSURE(column != -1, OUT_OF_BOUNDS);
+
+  ecs_archetype_t *archetype = record->archetype;
+  ecs_column_inflate(archetype, column);
+  ecs_column_write(info, archetype->components[column], archetype->capacity,
+                   record->row, data);
+  if (info->buffered) {
+    ECS_ENSURE(__atomic_load_n(&registry->front_lock, __ATOMIC_RELAXED) &
+                   FRONT_WRITER,
+               "double buffered components cannot be set while systems run");
+    ecs_column_write(info, archetype->front[column], archetype->capacity,
+                     record->row, data);
+  }
+  ecs_archetype_touch_column(registry, archetype, column);
+  ecs_indices_set(registry, archetype, entity, component, record->row);
+}
+
+// takes ownership of type. archetypes missing from the graph are created one
+// component at a time, the same way ecs_attach creates them.
+static ecs_archetype_t *ecs_archetype_find_or_create(ecs_registry_t *registry,
+                                                     ecs_type_t *type) {
+  ecs_archetype_t **found = ecs_map_get(registry->type_index, type);
+  if (found != NULL) {
+    ecs_type_free(type);
+    return *found;
+  }
+
+  uint32_t len = ecs_type_len(type);
+  ECS_ASSERT(len > 0, SOMETHING_TERRIBLE);
+  ecs_entity_t last = type->elements[len - 1];
+  ecs_type_t *left_type = ecs_type_copy(type);
+  ecs_type_remove(left_type, last);
+  ecs_archetype_t *left = ecs_archetype_find_or_create(registry, left_type);
+
+  return ecs_archetype_insert_vertex(registry->root, left, type, last,
+                                     registry->component_index,
+                                     registry->type_index);
+}
+
+// fills the hole at row with the archetype's last entity and forgets the
+// removed one
+static void ecs_archetype_remove_row(ecs_registry_t *registry,
+                                     ecs_archetype_t *archetype,
+                                     uint32_t row) {
+  row = ecs_archetype_unplace(registry, archetype, row);
+  ecs_entity_t removed = archetype->entity_ids[row];
+  uint32_t last = archetype->count - 1;
+
+  if (row != last) {
+    ecs_archetype_inflate(archetype);
+    uint32_t i = 0;
+    ECS_TYPE_EACH(archetype->type, e, {
+      ecs_component_info_t *info =
+          ecs_map_get(registry->component_index, (void *)e);
+      ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+      ecs_column_copy(info, archetype->components[i], archetype->capacity, row,
+                      archetype->components[i], archetype->capacity, last);
+      if (info->buffered) {
+        ecs_column_copy(info, archetype->front[i], archetype->capacity, row,
+                        archetype->front[i], archetype->capacity, last);
+      }
+      i++;
+    });
+
+    archetype->entity_ids[row] = archetype->entity_ids[last];
+    ecs_record_t *moved = ecs_map_get(registry->entity_index,
+                                      (void *)archetype->entity_ids[row]);
+    ECS_ASSERT(moved != NULL, FAILED_LOOKUP);
+    moved->row = row;
+  }
+
+  archetype->count--;
+  ecs_map_remove(registry->entity_index, (void *)removed);
+}
+
+static inline void ecs_ensure_migratable(const ecs_registry_t *dst,
+                                         const ecs_registry_t *src) {
+  ECS_ENSURE(dst != src, "entities are already in this registry");
+  ECS_ENSURE(dst->definitions == src->definitions,
+             "registries must share component definitions");
+  ecs_ensure_structural(dst);
+  ecs_ensure_structural(src);
+}
+
+// moves entities to another world, keeping their ids. worlds made with
+// ecs_init_shared share one id space, so ids stay unique and any component
+// that stores an entity id still points at the right entity afterwards.
+void ecs_migrate(ecs_registry_t *dst, ecs_registry_t *src,
+                 const ecs_entity_t *entities, uint32_t count) {
+  ecs_ensure_migratable(dst, src);
+
+  ecs_archetype_t *from = NULL, *to = NULL;
+  for (uint32_t n = 0; n < count; n++) {
+    ecs_record_t *record =
+        ecs_map_get(src->entity_index, (void *)entities[n]);
+    ECS_ENSURE(record != NULL, FAILED_LOOKUP);
+    uint32_t src_row = record->row;
+
+    // entities from the same archetype usually come in runs
+    if (record->archetype != from) {
+      from = record->archetype;
+      to = ecs_archetype_find_or_create(dst, ecs_type_copy(from->type));
+      ecs_archetype_inflate(from);
+      ecs_archetype_inflate(to);
+    }
+
+    uint32_t dst_row = ecs_archetype_add(to, dst->component_index,
+                                         dst->entity_index, entities[n]);
+    uint32_t i = 0;
+    ECS_TYPE_EACH(from->type, e, {
+      ecs_component_info_t *info =
+          ecs_map_get(src->component_index, (void *)e);
+      ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+      ecs_column_copy(info, to->components[i], to->capacity, dst_row,
+                      from->components[i], from->capacity, src_row);
+      if (info->buffered) {
+        ecs_column_copy(info, to->front[i], to->capacity, dst_row,
+                        from->front[i], from->capacity, src_row);
+      }
+      i++;
+    });
+
+    ecs_archetype_place(dst, to, dst_row);
+    ecs_archetype_remove_row(src, from, src_row);
+    ecs_archetype_touch(dst, to);
+    ecs_archetype_touch(src, from);
+  }
+
+  dst->epoch++;
+  src->epoch++;
+}
+
+static void ecs_column_append(const ecs_component_info_t *info, void *dst,
+                              uint32_t dst_capacity, uint32_t dst_count,
+                              const void *src, uint32_t src_capacity,
+                              uint32_t src_count) {
+  if (info->field_count == 0) {
+    memcpy(ECS_OFFSET(dst, info->size * dst_count), src,
+           info->size * src_count);
+    return;
+  }
+
+  size_t start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    size_t size = info->fields[k].size;
+    memcpy(ECS_OFFSET(dst, dst_capacity * start + size * dst_count),
+           ECS_OFFSET(src, src_capacity * start), size * src_count);
+    start += size;
+  }
+}
+
+// moves every entity with at least the components in signature, one memcpy
+// per column per archetype
+void ecs_migrate_matching(ecs_registry_t *dst, ecs_registry_t *src,
+                          ecs_signature_t *signature) {
+  ecs_ensure_migratable(dst, src);
+
+  ecs_query_t query;
+  ecs_query_init(&query, signature);
+  ecs_query_update(&query, src->type_index, src->component_index);
+
+  for (uint32_t q = 0; q < query.count; q++) {
+    ecs_archetype_t *from = query.archetypes[q];
+    if (from->count == 0) {
+      continue;
+    }
+
+    ecs_archetype_t *to =
+        ecs_archetype_find_or_create(dst, ecs_type_copy(from->type));
+    ecs_archetype_inflate(from);
+    ecs_archetype_inflate(to);
+    ecs_archetype_reserve(to, dst->component_index, to->count + from->count);
+
+    uint32_t i = 0;
+    ECS_TYPE_EACH(from->type, e, {
+      ecs_component_info_t *info =
+          ecs_map_get(src->component_index, (void *)e);
+      ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+      ecs_column_append(info, to->components[i], to->capacity, to->count,
+                        from->components[i], from->capacity, from->count);
+      if (info->buffered) {
+        ecs_column_append(info, to->front[i], to->capacity, to->count,
+                          from->front[i], from->capacity, from->count);
+      }
+      i++;
+    });
+
+    memcpy(&to->entity_ids[to->count], from->entity_ids,
+           sizeof(ecs_entity_t) * from->count);
+    for (uint32_t row = 0; row < from->count; row++) {
+      ecs_entity_t entity = from->entity_ids[row];
+      ecs_map_set(dst->entity_index, (void *)entity,
+                  &(ecs_record_t){to, to->count + row});
+      ecs_map_remove(src->entity_index, (void *)entity);
+    }
+
+    uint32_t first = to->count;
+    to->count += from->count;
+    from->count = 0;
+    for (uint32_t row = first; row < to->count; row++) {
+      ecs_archetype_place(dst, to, row);
+    }
+    ecs_archetype_touch(dst, to);
+    ecs_archetype_touch(src, from);
+  }
+
+  ecs_query_fini(&query);
+  dst->epoch++;
+  src->epoch++;
+}
+
+void ecs_deterministic(ecs_registry_t *registry) {
+  ecs_ensure_writable(registry);
+  ECS_ENSURE(ecs_map_len(registry->entity_index) == 0 &&
+                 ecs_map_len(registry->system_index) == 0,
+             "registry must be deterministic from the start");
+  registry->deterministic = true;
+}
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_STRIPE 64
+#define HASH_BLOCK_STRIPES 16
+
+static const uint64_t ecs_hash_key[8] = {
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL,
+    0x1F67B3B7A4A44072ULL, 0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL,
+    0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL,
+};
+
+static void ecs_hash_stripes(uint64_t *acc, const unsigned char *p,
+                             size_t stripes);
+
+static inline uint64_t ecs_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t ecs_hash_round(uint64_t acc, uint64_t word) {
+  acc += word * HASH_PRIME_2;
+  return ecs_rotl(acc, 31) * HASH_PRIME_1;
+}
+
+// in the spirit of xxHash. long inputs go through eight lanes in 64 byte
+// stripes (see ecs_hash_stripes_scalar), with the lanes scrambled after every
+// block of stripes, and the rest is hashed a word at a time.
+static uint64_t ecs_hash_bytes(uint64_t hash, const void *data, size_t bytes) {
+  const unsigned char *p = data;
+  if (bytes >= HASH_STRIPE) {
+    uint64_t acc[8] = {hash,         HASH_PRIME_1, HASH_PRIME_2,
+                       HASH_PRIME_3, HASH_PRIME_4, hash ^ HASH_PRIME_1,
+                       hash ^ HASH_PRIME_2, ~hash};
+    size_t stripes = bytes / HASH_STRIPE;
+    while (stripes > 0) {
+      size_t n = stripes < HASH_BLOCK_STRIPES ? stripes : HASH_BLOCK_STRIPES;
+      ecs_hash_stripes(acc, p, n);
+      p += n * HASH_STRIPE;
+      bytes -= n * HASH_STRIPE;
+      stripes -= n;
+
+      for (int lane = 0; lane < 8; lane++) {
+        acc[lane] ^= acc[lane] >> 47;
+        acc[lane] ^= ecs_hash_key[lane];
+        acc[lane] *= HASH_PRIME_1;
+      }
+    }
+
+    for (int lane = 0; lane < 8; lane++) {
+      hash = ecs_hash_round(hash, acc[lane]);
+    }
+  }
+
+  for (; bytes >= sizeof(uint64_t); bytes -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(uint64_t));
+    hash = ecs_hash_round(hash, word);
+    p += sizeof(uint64_t);
+  }
+
+  if (bytes != 0) {
+    uint64_t word = 0;
+    memcpy(&word, p, bytes);
+    hash = ecs_hash_round(hash ^ bytes, word);
+  }
+
+  return hash;
+}
+
+static inline uint64_t ecs_hash_finish(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME_2;
+  hash ^= hash >> 29;
+  hash *= HASH_PRIME_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+static uint64_t ecs_hash_column(uint64_t hash, const ecs_component_info_t *info,
+                                const void *column, uint32_t capacity,
+                                uint32_t count) {
+  if (info->field_count == 0) {
+    return ecs_hash_bytes(hash, column, info->size * count);
+  }
+
+  size_t start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    hash = ecs_hash_bytes(hash, ECS_OFFSET(column, capacity * start),
+                          info->fields[k].size * count);
+    start += info->fields[k].size;
+  }
+  return hash;
+}
+
+// ecs_hash_column over a stored column. a compressed one is unpacked into
+// scratch memory for the hash and stays packed.
+static uint64_t ecs_hash_stored(uint64_t hash, const ecs_component_info_t *info,
+                                const ecs_archetype_t *archetype,
+                                uint32_t column) {
+  if (!ecs_column_cold(archetype, column)) {
+    return ecs_hash_column(hash, info, archetype->components[column],
+                           archetype->capacity, archetype->count);
+  }
+
+  void *rows = ecs_malloc((size_t)info->size * archetype->count);
+  ecs_cold_unpack(&archetype->cold[column], rows);
+  hash = ecs_hash_column(hash, info, rows, archetype->count, archetype->count);
+  free(rows);
+  return hash;
+}
+
+static int ecs_archetype_compare(const void *a, const void *b) {
+  return ecs_type_compare((*(ecs_archetype_t *const *)a)->type,
+                          (*(ecs_archetype_t *const *)b)->type);
+}
+
+// hashes every entity and component value, archetypes in type order and rows
+// in storage order, so two deterministic registries in the same state agree.
+// components are hashed as raw bytes, so padding should be zeroed.
+uint64_t ecs_world_hash(const ecs_registry_t *registry) {
+  uint32_t archetype_count = ecs_map_len(registry->type_index);
+  ecs_archetype_t **archetypes =
+      ecs_malloc(sizeof(ecs_archetype_t *) * archetype_count);
+  memcpy(archetypes, ecs_map_values(registry->type_index),
+         sizeof(ecs_archetype_t *) * archetype_count);
+  qsort(archetypes, archetype_count, sizeof(ecs_archetype_t *),
+        ecs_archetype_compare);
+
+  uint64_t hash = HASH_PRIME_3;
+  for (uint32_t a = 0; a < archetype_count; a++) {
+    const ecs_archetype_t *archetype = archetypes[a];
+    if (archetype->count == 0) {
+      continue;
+    }
+
+    hash = ecs_hash_bytes(hash, archetype->type->elements,
+                          sizeof(ecs_entity_t) * archetype->type->count);
+    hash = ecs_hash_bytes(hash, archetype->entity_ids,
+                          sizeof(ecs_entity_t) * archetype->count);
+
+    uint32_t i = 0;
+    ECS_TYPE_EACH(archetype->type, e, {
+      const ecs_component_info_t *info =
+          ecs_map_get(registry->component_index, (void *)e);
+      ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+      hash = ecs_hash_stored(hash, info, archetype, i);
+      i++;
+    });
+  }
+
+  free(archetypes);
+  return ecs_hash_finish(hash);
+}
+
+static bool ecs_checksum_wants(const ecs_entity_t *components, uint32_t count,
+                               ecs_entity_t component) {
+  if (count == 0) {
+    return true;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (components[i] == component) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// like ecs_world_hash, restricted to the given components (all of them when
+// count is zero). columns that have not changed since they were last hashed
+// reuse the cached result, so a quiet world costs one pass over archetypes.
+uint64_t ecs_checksum(ecs_registry_t *registry, const ecs_entity_t *components,
+                      uint32_t count) {
+  ecs_ensure_writable(registry);
+  uint32_t archetype_count = ecs_map_len(registry->type_index);
+  ecs_archetype_t **archetypes =
+      ecs_malloc(sizeof(ecs_archetype_t *) * archetype_count);
+  memcpy(archetypes, ecs_map_values(registry->type_index),
+         sizeof(ecs_archetype_t *) * archetype_count);
+  qsort(archetypes, archetype_count, sizeof(ecs_archetype_t *),
+        ecs_archetype_compare);
+
+  uint64_t hash = HASH_PRIME_3;
+  for (uint32_t a = 0; a < archetype_count; a++) {
+    ecs_archetype_t *archetype = archetypes[a];
+    if (archetype->count == 0) {
+      continue;
+    }
+
+    if (archetype->ids_hashed_at <= archetype->rows_changed) {
+      archetype->ids_hash =
+          ecs_hash_bytes(HASH_PRIME_1, archetype->entity_ids,
+                         sizeof(ecs_entity_t) * archetype->count);
+      archetype->ids_hashed_at = ++registry->change_tick;
+    }
+    hash = ecs_hash_round(hash, archetype->ids_hash);
+
+    uint32_t i = 0;
+    ECS_TYPE_EACH(archetype->type, e, {
+      if (ecs_checksum_wants(components, count, e)) {
+        if (archetype->hashed_at[i] <= archetype->changed[i]) {
+          const ecs_component_info_t *info =
+              ecs_map_get(registry->component_index, (void *)e);
+          ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+          archetype->column_hash[i] =
+              ecs_hash_stored(HASH_PRIME_1 ^ e, info, archetype, i);
+          archetype->hashed_at[i] = ++registry->change_tick;
+        }
+        hash = ecs_hash_round(hash, archetype->column_hash[i]);
+      }
+      i++;
+    });
+  }
+
+  free(archetypes);
+  return ecs_hash_finish(hash);
+}
+
+static void ecs_index_catch_up(ecs_index_t *index);
+
+// the first reader in checks the registry and gets it ready while holding
+// READ_PREPARING, which keeps writers out and makes the next readers wait
+static void ecs_read_prepare(ecs_registry_t *registry) {
+  // readers would race to unpack them
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    ECS_ENSURE((*archetype)->cold_count == 0,
+               "compressed columns must be inflated before a read phase");
+  });
+  // and to rescan indices, so lookups find them ready
+  for (uint32_t i = 0; i < registry->index_count; i++) {
+    ecs_index_catch_up(registry->indices[i]);
+  }
+}
+
+uint64_t ecs_read_begin(ecs_registry_t *registry) {
+  uint32_t readers = __atomic_load_n(&registry->readers, __ATOMIC_ACQUIRE);
+  for (;;) {
+    if (readers & READ_PREPARING) {
+      sched_yield();
+      readers = __atomic_load_n(&registry->readers, __ATOMIC_ACQUIRE);
+    } else if (readers == 0) {
+      if (__atomic_compare_exchange_n(&registry->readers, &readers,
+                                      READ_PREPARING, true, __ATOMIC_ACQUIRE,
+                                      __ATOMIC_ACQUIRE)) {
+        ecs_read_prepare(registry);
+        __atomic_store_n(&registry->readers, 1, __ATOMIC_RELEASE);
+        return registry->epoch;
+      }
+    } else if (__atomic_compare_exchange_n(&registry->readers, &readers,
+                                           readers + 1, true, __ATOMIC_ACQUIRE,
+                                           __ATOMIC_ACQUIRE)) {
+      return registry->epoch;
+    }
+  }
+}
+
+void ecs_read_end(ecs_registry_t *registry) {
+  uint32_t readers =
+      __atomic_fetch_sub(&registry->readers, 1, __ATOMIC_RELEASE);
+  ECS_ENSURE(readers > 0, "ecs_read_end without ecs_read_begin");
+}
+
+uint64_t ecs_epoch(const ecs_registry_t *registry) { return registry->epoch; }
+
+static const void *ecs_get_help(const ecs_registry_t *registry,
+                                ecs_entity_t entity, ecs_entity_t component,
+                                bool front) {
+  const ecs_record_t *record =
+      ecs_map_get(registry->entity_index, (void *)entity);
+  ECS_ENSURE(record != NULL, FAILED_LOOKUP);
+
+  ecs_archetype_t *archetype = record->archetype;
+  int32_t column = ecs_type_index_of(archetype->type, component);
+  if (column == -1) {
+    return NULL;
+  }
+  ECS_ASSERT(!ecs_column_cold(archetype, column) ||
+                 __atomic_load_n(&registry->readers, __ATOMIC_ACQUIRE) == 0,
+             SOMETHING_TERRIBLE);
+  ecs_column_inflate(archetype, column);
+
+  const ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(info->field_count == 0,
+             "split components are read with ecs_get_split");
+  void *array = front && info->buffered ? archetype->front[column]
+                                        : archetype->components[column];
+  return ECS_OFFSET(array, info->size * record->row);
+}
+
+// returns NULL when the entity does not have the component. the only write is
+// unpacking a compressed column, so that the pointer stays valid like any
+// other. ecs_read_begin refuses to start while any column is packed, so inside
+// a read phase nothing is written and concurrent calls are safe.
+const void *ecs_get(const ecs_registry_t *registry, ecs_entity_t entity,
+                    ecs_entity_t component) {
+  return ecs_get_help(registry, entity, component, false);
+}
+
+const void *ecs_get_front(const ecs_registry_t *registry, ecs_entity_t entity,
+                          ecs_entity_t component) {
+  return ecs_get_help(registry, entity, component, true);
+}
+
+// packed columns are read in place, so unlike ecs_get this writes nothing and
+// works in a read phase whatever ecs_compress_cold has done
+bool ecs_get_split(const ecs_registry_t *registry, ecs_entity_t entity,
+                   ecs_entity_t component, void *out) {
+  const ecs_record_t *record =
+      ecs_map_get(registry->entity_index, (void *)entity);
+  ECS_ENSURE(record != NULL, FAILED_LOOKUP);
+
+  const ecs_archetype_t *archetype = record->archetype;
+  int32_t column = ecs_type_index_of(archetype->type, component);
+  if (column == -1) {
+    return false;
+  }
+
+  const ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+  if (ecs_column_cold(archetype, column)) {
+    memcpy(out, ecs_cold_row(&archetype->cold[column], record->row),
+           info->size);
+  } else {
+    ecs_column_read(info, archetype->components[column], archetype->capacity,
+                    record->row, out);
+  }
+  return true;
+}
+
+#define PARALLEL_DEFAULT_GRAIN 1024
+#define PARALLEL_TASKS_PER_WORKER 4
+
+typedef struct ecs_parallel_job_t {
+  const ecs_system_t *sys;
+  ecs_view_t view;
+  uint32_t type_len;
+  uint32_t count;
+  uint32_t range;
+} ecs_parallel_job_t;
+
+static void ecs_parallel_job(void *data, uint32_t index) {
+  const ecs_parallel_job_t *job = data;
+  const ecs_system_t *sys = job->sys;
+  uint32_t start = index * job->range;
+  uint32_t end = job->count - start < job->range ? job->count
+                                                  : start + job->range;
+  ecs_view_t view = job->view;
+
+  if (!sys->chunk) {
+    for (uint32_t i = start; i < end; i++) {
+      sys->run(view, i);
+    }
+    return;
+  }
+
+  // chunk systems see their range as a smaller archetype starting at row 0
+  void *component_arrays[job->type_len];
+  for (uint32_t i = 0; i < sys->query.sig->count; i++) {
+    uint32_t column = view.signature_to_index[i];
+    component_arrays[column] = ECS_OFFSET(
+        view.component_arrays[column], (size_t)view.component_sizes[i] * start);
+  }
+  view.component_arrays = component_arrays;
+  sys->run(view, end - start);
+}
+
+static inline uint32_t ecs_gcd(uint32_t a, uint32_t b) {
+  while (b != 0) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// enough ranges to keep every worker busy, but no smaller than the grain. the
+// length is a multiple of the rows that fill a whole number of cache lines in
+// every column, so neighbouring ranges never write to the same line.
+static uint32_t ecs_parallel_range(const ecs_system_t *sys, uint32_t count,
+                                   uint32_t workers) {
+  uint32_t align = 1;
+  for (uint32_t i = 0; i < sys->query.sig->count; i++) {
+    uint32_t size = sys->query.component_sizes[i];
+    uint32_t rows = CACHE_LINE / ecs_gcd(CACHE_LINE, size);
+    align = rows > align ? rows : align; // powers of two, so this is the lcm
+  }
+
+  uint32_t grain = sys->grain != 0 ? sys->grain : PARALLEL_DEFAULT_GRAIN;
+  uint32_t tasks = workers * PARALLEL_TASKS_PER_WORKER;
+  uint32_t range = (count + tasks - 1) / tasks;
+  if (range < grain) {
+    range = grain;
+  }
+
+  return (range + align - 1) / align * align;
+}
+
+static void ecs_step_help(const ecs_registry_t *registry,
+                          const ecs_system_t *sys, uint32_t index,
+                          float delta_time) {
+  ecs_archetype_t *archetype = sys->query.archetypes[index];
+  if (archetype->count == 0) {
+    return;
+  }
+
+  ecs_view_t view = ecs_query_view(&sys->query, index);
+  view.delta_time = delta_time;
+
+  if (sys->parallel) {
+    uint32_t range =
+        ecs_parallel_range(sys, archetype->count, registry->workers);
+    uint32_t tasks = (archetype->count + range - 1) / range;
+    ecs_parallel_job_t job = {sys, view, ecs_type_len(archetype->type),
+                              archetype->count, range};
+
+    if (registry->parallel != NULL && tasks > 1) {
+      registry->parallel(ecs_parallel_job, &job, tasks,
+                         registry->parallel_ctx);
+    } else {
+      for (uint32_t i = 0; i < tasks; i++) {
+        ecs_parallel_job(&job, i);
+      }
+    }
+    return;
+  }
+
+  if (sys->chunk) {
+    sys->run(view, archetype->count);
+    return;
+  }
+
+  for (uint32_t i = sys->stride_offset; i < archetype->count;
+       i += sys->stride) {
+    sys->run(view, i);
+  }
+}
+
+static inline uint64_t ecs_clock_usec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// the clock is read again once the rows run at the pace so far would take
+// this share of the time left, so a slice overruns its budget by about that
+// share or one row, whichever is longer
+#define SYSTEM_CLOCK_SHARE 4
+
+// adds the rows a run went over to the access counts of the columns it reads,
+// which is how cold columns are found
+static inline void ecs_system_visited(const ecs_system_t *sys, uint32_t index,
+                                      uint32_t rows) {
+  ecs_archetype_t *archetype = sys->query.archetypes[index];
+  const uint32_t *columns = &sys->query.columns[index * sys->query.sig->count];
+  for (uint32_t j = 0; j < sys->query.sig->count; j++) {
+    archetype->accesses[columns[j]] += rows;
+  }
+}
+
+// rows are visited in archetype order starting at the cursor. entities moved
+// between archetypes since the last run may be skipped or visited twice in a
+// sweep.
+static void ecs_system_run_sliced(ecs_system_t *sys, float delta_time) {
+  const ecs_query_t *query = &sys->query;
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < query->count; i++) {
+    total += query->archetypes[i]->count;
+  }
+
+  uint64_t limit = total;
+  if (sys->max_rows != 0 && sys->max_rows < limit) {
+    limit = sys->max_rows;
+  }
+  uint64_t start = sys->max_usec != 0 ? ecs_clock_usec() : 0;
+  uint64_t deadline = sys->max_usec != 0 ? start + sys->max_usec : 0;
+
+  uint64_t done = 0, next_check = 1;
+  while (done < limit) {
+    if (sys->cursor_archetype >= query->count) {
+      sys->cursor_archetype = 0;
+      sys->cursor_row = 0;
+    }
+
+    ecs_archetype_t *archetype = query->archetypes[sys->cursor_archetype];
+    if (sys->cursor_row >= archetype->count) {
+      sys->cursor_archetype++;
+      sys->cursor_row = 0;
+      continue;
+    }
+
+    ecs_view_t view = ecs_query_view(query, sys->cursor_archetype);
+    view.delta_time = delta_time;
+    uint32_t first = sys->cursor_row;
+    while (sys->cursor_row < archetype->count && done < limit) {
+      sys->run(view, sys->cursor_row++);
+      done++;
+
+      if (deadline == 0 || done < next_check) {
+        continue;
+      }
+      uint64_t now = ecs_clock_usec();
+      if (now >= deadline) {
+        ecs_system_visited(sys, sys->cursor_archetype, sys->cursor_row - first);
+        return;
+      }
+      // rows faster than the clock can tell apart double the interval
+      uint64_t elapsed = now - start;
+      uint64_t rows = elapsed == 0 ? done
+                                   : done * (deadline - now) /
+                                         (elapsed * SYSTEM_CLOCK_SHARE);
+      next_check = done + (rows != 0 ? rows : 1);
+    }
+    ecs_system_visited(sys, sys->cursor_archetype, sys->cursor_row - first);
+  }
+}
+
+static void ecs_system_run(ecs_registry_t *registry, ecs_system_t *sys,
+                           float delta_time) {
+  const ecs_query_t *query = &sys->query;
+  ecs_archetype_t *cursor = sys->cursor_archetype < query->count
+                                ? query->archetypes[sys->cursor_archetype]
+                                : NULL;
+  ecs_query_update(&sys->query, registry->type_index,
+                   registry->component_index);
+
+  // sorted queries insert archetypes anywhere, so find the cursor again
+  while (cursor != NULL && query->archetypes[sys->cursor_archetype] != cursor) {
+    sys->cursor_archetype++;
+  }
+
+  ecs_query_touch(registry, query);
+
+  if (sys->sliced) {
+    ecs_system_run_sliced(sys, delta_time);
+    return;
+  }
+
+  for (uint32_t i = 0; i < sys->query.count; i++) {
+    uint32_t count = query->archetypes[i]->count;
+    ecs_system_visited(sys, i,
+                       count > sys->stride_offset
+                           ? (count - sys->stride_offset - 1) / sys->stride + 1
+                           : 0);
+    ecs_step_help(registry, sys, i, delta_time);
+  }
+
+  sys->stride_offset = (sys->stride_offset + 1) % sys->stride;
+}
+
+static inline void ecs_system_drop_backlog(ecs_system_t *sys) {
+  if (sys->accumulator >= sys->interval) {
+    sys->accumulator -=
+        sys->interval * (uint64_t)(sys->accumulator / sys->interval);
+  }
+}
+
+#define SYSTEM_MAX_CATCH_UP 8
+
+static void ecs_system_tick(ecs_registry_t *registry, ecs_system_t *sys,
+                            float delta_time) {
+  switch (sys->timing) {
+  case SYSTEM_EVERY_STEP:
+    ecs_system_run(registry, sys, delta_time);
+    break;
+  case SYSTEM_RATE_LIMITED:
+    sys->accumulator += delta_time;
+    sys->since_run += delta_time;
+    if (sys->accumulator >= sys->interval) {
+      ecs_system_run(registry, sys, sys->since_run);
+      sys->accumulator -= sys->interval;
+      sys->since_run = 0.0;
+      ecs_system_drop_backlog(sys);
+    }
+    break;
+  case SYSTEM_FIXED:
+    // runs with the same delta time every time. after a long hitch, steps
+    // beyond SYSTEM_MAX_CATCH_UP are dropped instead of run late.
+    sys->accumulator += delta_time;
+    for (uint32_t runs = 0;
+         runs < SYSTEM_MAX_CATCH_UP && sys->accumulator >= sys->interval;
+         runs++) {
+      ecs_system_run(registry, sys, sys->interval);
+      sys->accumulator -= sys->interval;
+    }
+    ecs_system_drop_backlog(sys);
+    break;
+  }
+}
+
+// the front buffers are guarded by front_lock. the stepping thread holds it,
+// as FRONT_WRITER, all the time except while systems run, since systems only
+// write the back buffers: ecs_set on buffered components and structural
+// changes are refused without the bit, and spawners wait for ecs_sync.
+// ecs_front_begin waits for the bit to clear and then counts itself in; the
+// step sets the bit again once systems are done and waits for the readers to
+// leave before it touches the fronts.
+
+uint64_t ecs_front_begin(ecs_registry_t *registry) {
+  uint32_t lock = __atomic_load_n(&registry->front_lock, __ATOMIC_RELAXED);
+  for (;;) {
+    if (lock & FRONT_WRITER) {
+      sched_yield();
+      lock = __atomic_load_n(&registry->front_lock, __ATOMIC_RELAXED);
+    } else if (__atomic_compare_exchange_n(&registry->front_lock, &lock,
+                                           lock + 1, true, __ATOMIC_ACQUIRE,
+                                           __ATOMIC_RELAXED)) {
+      return __atomic_load_n(&registry->generation, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void ecs_front_end(ecs_registry_t *registry) {
+  uint32_t lock =
+      __atomic_fetch_sub(&registry->front_lock, 1, __ATOMIC_RELEASE);
+  ECS_ENSURE((lock & ~FRONT_WRITER) > 0,
+             "ecs_front_end without ecs_front_begin");
+}
+
+static void ecs_front_release(ecs_registry_t *registry) {
+  __atomic_fetch_and(&registry->front_lock, ~FRONT_WRITER, __ATOMIC_RELEASE);
+}
+
+static void ecs_front_acquire(ecs_registry_t *registry) {
+  __atomic_fetch_or(&registry->front_lock, FRONT_WRITER, __ATOMIC_RELAXED);
+  while (__atomic_load_n(&registry->front_lock, __ATOMIC_ACQUIRE) !=
+         FRONT_WRITER) {
+    sched_yield();
+  }
+}
+
+// makes this step's writes to double buffered components visible in the front
+// buffers. swapping the pointers instead would leave systems updating values
+// from two steps ago, so the written buffer is copied over the front one.
+// ecs_set and structural changes keep both buffers in step themselves, so only
+// columns written since the last publish are copied.
+static void ecs_publish_buffers(ecs_registry_t *registry) {
+  if (registry->definitions->buffered_count == 0) {
+    return;
+  }
+
+  uint64_t published = registry->published;
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    ecs_archetype_t *a = *archetype;
+    uint32_t i = 0;
+    ECS_TYPE_EACH(a->type, e, {
+      if (a->front[i] != NULL && a->count != 0 && a->changed[i] > published) {
+        ecs_component_info_t *info =
+            ecs_map_get(registry->component_index, (void *)e);
+        ECS_ASSERT(info != NULL, FAILED_LOOKUP);
+        size_t bytes = info->field_count == 0
+                           ? info->size * a->count
+                           : ecs_column_row_size(info) * a->capacity;
+        memcpy(a->front[i], a->components[i], bytes);
+      }
+      i++;
+    });
+  });
+  registry->published = registry->change_tick;
+  __atomic_store_n(&registry->generation, registry->generation + 1,
+                   __ATOMIC_RELAXED);
+}
+
+void ecs_step_delta(ecs_registry_t *registry, float delta_time) {
+  ecs_ensure_writable(registry);
+  if (registry->schedule_dirty) {
+    ecs_schedule_resolve(registry);
+  }
+
+  ecs_front_release(registry);
+  for (uint32_t i = 0; i < registry->schedule_count; i++) {
+    ecs_system_t *sys =
+        ecs_map_get(registry->system_index, (void *)registry->schedule[i]);
+    ECS_ASSERT(sys != NULL, FAILED_LOOKUP);
+    if (sys->enabled) {
+      ecs_system_tick(registry, sys, delta_time);
+    }
+  }
+  ecs_front_acquire(registry);
+
+  ecs_publish_buffers(registry);
+  ecs_sync(registry);
+}
+
+void ecs_step(ecs_registry_t *registry) { ecs_step_delta(registry, 0.0f); }
+
+void *ecs_view(ecs_view_t view, uint32_t row, uint32_t column) {
+  ECS_ASSERT(view.component_fields[column] == NULL,
+             "split components are viewed with ecs_view_field");
   void *component_array =
       view.component_arrays[view.signature_to_index[column]];
   return ECS_OFFSET(component_array, view.component_sizes[column] * row);
 }
+
+void *ecs_view_column(ecs_view_t view, uint32_t column) {
+  return ecs_view(view, 0, column);
+}
+
+void *ecs_view_field(ecs_view_t view, uint32_t row, uint32_t column,
+                     uint32_t field) {
+  const ecs_field_t *fields = view.component_fields[column];
+  ECS_ASSERT(fields != NULL, "component is not split into fields");
+
+  size_t start = 0;
+  for (uint32_t k = 0; k < field; k++) {
+    start += fields[k].size;
+  }
+
+  void *component_array =
+      view.component_arrays[view.signature_to_index[column]];
+  return ECS_OFFSET(component_array,
+                    view.capacity * start + fields[field].size * row);
+}
+
+// kernels never use fused multiply-add so every instruction set rounds the
+// same way as the scalar loops.
+
+static void ecs_axpy_scalar(float *y, const float *x, float a, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+static void ecs_scale_scalar(float *x, float a, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+static void ecs_clamp_scalar(float *x, float lo, float hi, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    x[i] = x[i] < lo ? lo : x[i] > hi ? hi : x[i];
+  }
+}
+
+static void ecs_lerp_scalar(float *x, const float *target, float t,
+                            uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    x[i] += (target[i] - x[i]) * t;
+  }
+}
+
+#ifdef ECS_KERNELS_X86
+__attribute__((target("sse"))) static void
+ecs_axpy_sse(float *y, const float *x, float a, uint32_t n) {
+  __m128 va = _mm_set1_ps(a);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 vy = _mm_loadu_ps(y + i);
+    _mm_storeu_ps(y + i, _mm_add_ps(vy, _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+  }
+  ecs_axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("sse"))) static void ecs_scale_sse(float *x, float a,
+                                                        uint32_t n) {
+  __m128 va = _mm_set1_ps(a);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), va));
+  }
+  ecs_scale_scalar(x + i, a, n - i);
+}
+
+__attribute__((target("sse"))) static void
+ecs_clamp_sse(float *x, float lo, float hi, uint32_t n) {
+  __m128 vlo = _mm_set1_ps(lo);
+  __m128 vhi = _mm_set1_ps(hi);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(x + i);
+    _mm_storeu_ps(x + i, _mm_min_ps(_mm_max_ps(v, vlo), vhi));
+  }
+  ecs_clamp_scalar(x + i, lo, hi, n - i);
+}
+
+__attribute__((target("sse"))) static void
+ecs_lerp_sse(float *x, const float *target, float t, uint32_t n) {
+  __m128 vt = _mm_set1_ps(t);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(x + i);
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(target + i), v);
+    _mm_storeu_ps(x + i, _mm_add_ps(v, _mm_mul_ps(d, vt)));
+  }
+  ecs_lerp_scalar(x + i, target + i, t, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+ecs_axpy_avx2(float *y, const float *x, float a, uint32_t n) {
+  __m256 va = _mm256_set1_ps(a);
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 vy = _mm256_loadu_ps(y + i);
+    __m256 vx = _mm256_loadu_ps(x + i);
+    _mm256_storeu_ps(y + i, _mm256_add_ps(vy, _mm256_mul_ps(va, vx)));
+  }
+  ecs_axpy_sse(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx2"))) static void ecs_scale_avx2(float *x, float a,
+                                                          uint32_t n) {
+  __m256 va = _mm256_set1_ps(a);
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), va));
+  }
+  ecs_scale_sse(x + i, a, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+ecs_clamp_avx2(float *x, float lo, float hi, uint32_t n) {
+  __m256 vlo = _mm256_set1_ps(lo);
+  __m256 vhi = _mm256_set1_ps(hi);
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    _mm256_storeu_ps(x + i, _mm256_min_ps(_mm256_max_ps(v, vlo), vhi));
+  }
+  ecs_clamp_sse(x + i, lo, hi, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+ecs_lerp_avx2(float *x, const float *target, float t, uint32_t n) {
+  __m256 vt = _mm256_set1_ps(t);
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(target + i), v);
+    _mm256_storeu_ps(x + i, _mm256_add_ps(v, _mm256_mul_ps(d, vt)));
+  }
+  ecs_lerp_sse(x + i, target + i, t, n - i);
+}
+#endif // ECS_KERNELS_X86
+
+// each 64 byte stripe adds every word to the neighbouring lane and the product
+// of the halves of word ^ key to its own lane. 32 bit multiplies vectorize on
+// every instruction set, and all of them produce the same hash.
+static void ecs_hash_stripes_scalar(uint64_t *acc, const unsigned char *p,
+                                    size_t stripes) {
+  for (size_t s = 0; s < stripes; s++) {
+    for (int lane = 0; lane < 8; lane++) {
+      uint64_t word;
+      memcpy(&word, p + lane * sizeof(uint64_t), sizeof(uint64_t));
+      uint64_t mixed = word ^ ecs_hash_key[lane];
+      acc[lane ^ 1] += word;
+      acc[lane] += (mixed & 0xFFFFFFFF) * (mixed >> 32);
+    }
+    p += HASH_STRIPE;
+  }
+}
+
+#ifdef ECS_KERNELS_X86
+__attribute__((target("avx2"))) static void
+ecs_hash_stripes_avx2(uint64_t *acc, const unsigned char *p, size_t stripes) {
+  __m256i acc_lo = _mm256_loadu_si256((const __m256i *)acc);
+  __m256i acc_hi = _mm256_loadu_si256((const __m256i *)(acc + 4));
+  __m256i key_lo = _mm256_loadu_si256((const __m256i *)ecs_hash_key);
+  __m256i key_hi = _mm256_loadu_si256((const __m256i *)(ecs_hash_key + 4));
+
+  for (size_t s = 0; s < stripes; s++) {
+    __m256i word_lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i word_hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i mixed_lo = _mm256_xor_si256(word_lo, key_lo);
+    __m256i mixed_hi = _mm256_xor_si256(word_hi, key_hi);
+
+    // swapping neighbouring words gives every lane its neighbour's word
+    acc_lo = _mm256_add_epi64(
+        acc_lo, _mm256_shuffle_epi32(word_lo, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc_hi = _mm256_add_epi64(
+        acc_hi, _mm256_shuffle_epi32(word_hi, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc_lo = _mm256_add_epi64(
+        acc_lo, _mm256_mul_epu32(mixed_lo, _mm256_srli_epi64(mixed_lo, 32)));
+    acc_hi = _mm256_add_epi64(
+        acc_hi, _mm256_mul_epu32(mixed_hi, _mm256_srli_epi64(mixed_hi, 32)));
+    p += HASH_STRIPE;
+  }
+
+  _mm256_storeu_si256((__m256i *)acc, acc_lo);
+  _mm256_storeu_si256((__m256i *)(acc + 4), acc_hi);
+}
+#endif // ECS_KERNELS_X86
+
+static struct {
+  bool selected;
+  ecs_simd_t simd;
+  void (*axpy)(float *, const float *, float, uint32_t);
+  void (*scale)(float *, float, uint32_t);
+  void (*clamp)(float *, float, float, uint32_t);
+  void (*lerp)(float *, const float *, float, uint32_t);
+  void (*hash_stripes)(uint64_t *, const unsigned char *, size_t);
+} ecs_kernels;
+
+static ecs_simd_t ecs_kernel_detect(void) {
+#ifdef ECS_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return ECS_SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse")) {
+    return ECS_SIMD_SSE;
+  }
+#endif
+  return ECS_SIMD_SCALAR;
+}
+
+ecs_simd_t ecs_kernel_select(ecs_simd_t max) {
+  ecs_simd_t simd = ecs_kernel_detect();
+  if (simd > max) {
+    simd = max;
+  }
+
+  ecs_kernels.simd = simd;
+  ecs_kernels.axpy = ecs_axpy_scalar;
+  ecs_kernels.scale = ecs_scale_scalar;
+  ecs_kernels.clamp = ecs_clamp_scalar;
+  ecs_kernels.lerp = ecs_lerp_scalar;
+  ecs_kernels.hash_stripes = ecs_hash_stripes_scalar;
+
+#ifdef ECS_KERNELS_X86
+  if (simd == ECS_SIMD_SSE) {
+    ecs_kernels.axpy = ecs_axpy_sse;
+    ecs_kernels.scale = ecs_scale_sse;
+    ecs_kernels.clamp = ecs_clamp_sse;
+    ecs_kernels.lerp = ecs_lerp_sse;
+  } else if (simd == ECS_SIMD_AVX2) {
+    ecs_kernels.axpy = ecs_axpy_avx2;
+    ecs_kernels.scale = ecs_scale_avx2;
+    ecs_kernels.clamp = ecs_clamp_avx2;
+    ecs_kernels.lerp = ecs_lerp_avx2;
+    ecs_kernels.hash_stripes = ecs_hash_stripes_avx2;
+  }
+#endif
+
+  ecs_kernels.selected = true;
+  return simd;
+}
+
+ecs_simd_t ecs_kernel_simd(void) {
+  if (!ecs_kernels.selected) {
+    ecs_kernel_select(ECS_SIMD_AVX2);
+  }
+  return ecs_kernels.simd;
+}
+
+void ecs_kernel_axpy(float *y, const float *x, float a, uint32_t n) {
+  ecs_kernel_simd();
+  ecs_kernels.axpy(y, x, a, n);
+}
+
+void ecs_kernel_scale(float *x, float a, uint32_t n) {
+  ecs_kernel_simd();
+  ecs_kernels.scale(x, a, n);
+}
+
+void ecs_kernel_clamp(float *x, float lo, float hi, uint32_t n) {
+  ecs_kernel_simd();
+  ecs_kernels.clamp(x, lo, hi, n);
+}
+
+void ecs_kernel_lerp(float *x, const float *target, float t, uint32_t n) {
+  ecs_kernel_simd();
+  ecs_kernels.lerp(x, target, t, n);
+}
+
+static void ecs_hash_stripes(uint64_t *acc, const unsigned char *p,
+                             size_t stripes) {
+  ecs_kernel_simd();
+  ecs_kernels.hash_stripes(acc, p, stripes);
+}
+
+// replication. a baseline holds the last values sent (or received) for each
+// entity, one slot per entity with every selected component padded to whole
+// 32 bit words. the bit stream is, per entity that changed:
+//
+//   1                      another entity follows
+//   id                     zigzag delta from the previous id (7 bit length)
+//   mask                   one bit per selected component that changed
+//   per changed component  one bit per word, then for each changed word the
+//                          xor with the baseline (5 bit length - 1, bits)
+//
+// and a final 0. the word mask of a component fits in 32 bits, so components
+// are at most 128 bytes.
+
+#define DELTA_MAX_COMPONENTS 32
+#define DELTA_MAX_SIZE 128
+
+struct ecs_baseline_t {
+  uint32_t component_count;
+  ecs_entity_t components[DELTA_MAX_COMPONENTS];
+  size_t sizes[DELTA_MAX_COMPONENTS];
+  size_t offsets[DELTA_MAX_COMPONENTS]; // within a slot
+  size_t slot_size;
+  ecs_map_t *slots; // <ecs_entity_t, uint32_t>
+  uint32_t count;
+  uint32_t capacity;
+  unsigned char *values;
+  uint32_t *present; // mask of components each entity has had
+  ecs_entity_t *local; // the decoder's entity for each slot
+};
+
+ecs_baseline_t *ecs_baseline(const ecs_registry_t *registry,
+                             const ecs_entity_t *components, uint32_t count) {
+  ECS_ENSURE(count > 0 && count <= DELTA_MAX_COMPONENTS, OUT_OF_BOUNDS);
+
+  ecs_baseline_t *baseline = ecs_malloc(sizeof(ecs_baseline_t));
+  baseline->component_count = count;
+  baseline->slot_size = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const ecs_component_info_t *info =
+        ecs_map_get(registry->component_index, (void *)components[i]);
+    ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+    ECS_ENSURE(info->size <= DELTA_MAX_SIZE,
+               "replicated components are at most 128 bytes");
+    baseline->components[i] = components[i];
+    baseline->sizes[i] = info->size;
+    baseline->offsets[i] = baseline->slot_size;
+    baseline->slot_size += (info->size + 3) / 4 * 4;
+  }
+
+  baseline->slots = ECS_MAP(intptr, ecs_entity_t, uint32_t, 16);
+  baseline->count = 0;
+  baseline->capacity = 0;
+  baseline->values = NULL;
+  baseline->present = NULL;
+  baseline->local = NULL;
+  return baseline;
+}
+
+void ecs_baseline_free(ecs_baseline_t *baseline) {
+  ecs_map_free(baseline->slots);
+  free(baseline->values);
+  free(baseline->present);
+  free(baseline->local);
+  free(baseline);
+}
+
+static uint32_t ecs_baseline_slot(ecs_baseline_t *baseline,
+                                  ecs_entity_t entity) {
+  uint32_t *slot = ecs_map_get(baseline->slots, (void *)entity);
+  if (slot != NULL) {
+    return *slot;
+  }
+
+  if (baseline->count == baseline->capacity) {
+    baseline->capacity = baseline->capacity == 0 ? 16 : baseline->capacity * 2;
+    ecs_realloc((void **)&baseline->values,
+                baseline->slot_size * baseline->capacity);
+    ecs_realloc((void **)&baseline->present,
+                sizeof(uint32_t) * baseline->capacity);
+    ecs_realloc((void **)&baseline->local,
+                sizeof(ecs_entity_t) * baseline->capacity);
+  }
+
+  uint32_t index = baseline->count++;
+  memset(ECS_OFFSET(baseline->values, baseline->slot_size * index), 0,
+         baseline->slot_size);
+  baseline->present[index] = 0;
+  baseline->local[index] = 0;
+  ecs_map_set(baseline->slots, (void *)entity, &index);
+  return index;
+}
+
+ecs_entity_t ecs_baseline_local(const ecs_baseline_t *baseline,
+                                ecs_entity_t remote) {
+  const uint32_t *slot = ecs_map_get(baseline->slots, (void *)remote);
+  return slot == NULL ? 0 : baseline->local[*slot];
+}
+
+typedef struct ecs_bits_t {
+  unsigned char *data;
+  size_t size;  // bytes
+  size_t cursor; // bits
+  bool failed;  // read past the end or found a bad length
+} ecs_bits_t;
+
+// past the end of the buffer, only counts the bits that would be written
+static void ecs_bits_write(ecs_bits_t *bits, uint64_t value, uint32_t count) {
+  if (bits->cursor + count > bits->size * 8) {
+    bits->failed = true;
+    bits->cursor += count;
+    return;
+  }
+  for (uint32_t i = 0; i < count; i++, bits->cursor++) {
+    unsigned char mask = (unsigned char)(1u << (bits->cursor % 8));
+    if ((value >> i) & 1) {
+      bits->data[bits->cursor / 8] |= mask;
+    } else {
+      bits->data[bits->cursor / 8] &= (unsigned char)~mask;
+    }
+  }
+}
+
+// reads zero once the delta has failed, ending every loop over it
+static uint64_t ecs_bits_read(ecs_bits_t *bits, uint32_t count) {
+  if (bits->failed || count > 64 || bits->cursor + count > bits->size * 8) {
+    bits->failed = true;
+    return 0;
+  }
+  uint64_t value = 0;
+  for (uint32_t i = 0; i < count; i++, bits->cursor++) {
+    uint64_t bit = (bits->data[bits->cursor / 8] >> (bits->cursor % 8)) & 1;
+    value |= bit << i;
+  }
+  return value;
+}
+
+static inline uint32_t ecs_bit_length(uint64_t value) {
+  return value == 0 ? 0 : 64 - (uint32_t)__builtin_clzll(value);
+}
+
+static void ecs_bits_write_id(ecs_bits_t *bits, ecs_entity_t id,
+                              ecs_entity_t previous) {
+  int64_t delta = (int64_t)(id - previous);
+  uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  uint32_t length = ecs_bit_length(zigzag);
+  ecs_bits_write(bits, length, 7);
+  ecs_bits_write(bits, zigzag, length);
+}
+
+static ecs_entity_t ecs_bits_read_id(ecs_bits_t *bits, ecs_entity_t previous) {
+  uint32_t length = (uint32_t)ecs_bits_read(bits, 7);
+  if (length > 64) {
+    bits->failed = true;
+    return previous;
+  }
+  uint64_t zigzag = ecs_bits_read(bits, length);
+  int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  return previous + (ecs_entity_t)delta;
+}
+
+static inline uint32_t ecs_word_at(const unsigned char *p, size_t size,
+                                   size_t offset) {
+  uint32_t word = 0;
+  memcpy(&word, p + offset, size - offset < 4 ? size - offset : 4);
+  return word;
+}
+
+// writes the changes since the baseline for the given entities into out and
+// moves the baseline forward. returns the number of bytes written, or, like
+// snprintf, the number needed if that is more than capacity, in which case the
+// baseline is left as it was.
+size_t ecs_delta_encode(const ecs_registry_t *registry,
+                        ecs_baseline_t *baseline, const ecs_entity_t *entities,
+                        uint32_t count, void *out, size_t capacity) {
+  ecs_bits_t bits = {out, capacity, 0, false};
+  ecs_entity_t previous = 0;
+
+  // current values and changed masks, moved into the baseline once the whole
+  // delta is known to fit
+  unsigned char *values = ecs_malloc(baseline->slot_size * (count + 1));
+  uint32_t *changes = ecs_malloc(sizeof(uint32_t) * (count + 1));
+  unsigned char *unsent = ECS_OFFSET(values, baseline->slot_size * count);
+  memset(unsent, 0, baseline->slot_size);
+
+  for (uint32_t n = 0; n < count; n++) {
+    const ecs_record_t *record =
+        ecs_map_get(registry->entity_index, (void *)entities[n]);
+    ECS_ENSURE(record != NULL, FAILED_LOOKUP);
+    const ecs_archetype_t *archetype = record->archetype;
+
+    const uint32_t *slot = ecs_map_get(baseline->slots, (void *)entities[n]);
+    const unsigned char *sent =
+        slot == NULL
+            ? unsent
+            : ECS_OFFSET(baseline->values, baseline->slot_size * *slot);
+    uint32_t present = slot == NULL ? 0 : baseline->present[*slot];
+    unsigned char *value = ECS_OFFSET(values, baseline->slot_size * n);
+
+    // gather current values and find what changed
+    uint32_t changed = 0;
+    for (uint32_t i = 0; i < baseline->component_count; i++) {
+      ecs_entity_t component = baseline->components[i];
+      int32_t column = ecs_type_index_of(archetype->type, component);
+      if (column == -1) {
+        continue;
+      }
+
+      const ecs_component_info_t *info =
+          ecs_map_get(registry->component_index, (void *)component);
+      unsigned char *current = value + baseline->offsets[i];
+      if (ecs_column_cold(archetype, column)) {
+        memcpy(current, ecs_cold_row(&archetype->cold[column], record->row),
+               info->size);
+      } else {
+        ecs_column_read(info, archetype->components[column],
+                        archetype->capacity, record->row, current);
+      }
+      bool is_new = !(present & (1u << i));
+      if (is_new || memcmp(current, sent + baseline->offsets[i],
+                           baseline->sizes[i]) != 0) {
+        changed |= 1u << i;
+      }
+    }
+
+    changes[n] = changed;
+    if (changed == 0) {
+      continue;
+    }
+
+    ecs_bits_write(&bits, 1, 1);
+    ecs_bits_write_id(&bits, entities[n], previous);
+    previous = entities[n];
+    ecs_bits_write(&bits, changed, baseline->component_count);
+
+    for (uint32_t i = 0; i < baseline->component_count; i++) {
+      if (!(changed & (1u << i))) {
+        continue;
+      }
+
+      size_t size = baseline->sizes[i];
+      const unsigned char *current = value + baseline->offsets[i];
+      const unsigned char *old = sent + baseline->offsets[i];
+      for (size_t w = 0; w < size; w += 4) {
+        ecs_bits_write(&bits, ecs_word_at(current, size, w) !=
+                                  ecs_word_at(old, size, w),
+                       1);
+      }
+      for (size_t w = 0; w < size; w += 4) {
+        uint32_t diff =
+            ecs_word_at(current, size, w) ^ ecs_word_at(old, size, w);
+        if (diff != 0) {
+          uint32_t length = ecs_bit_length(diff);
+          ecs_bits_write(&bits, length - 1, 5);
+          ecs_bits_write(&bits, diff, length);
+        }
+      }
+    }
+  }
+  ecs_bits_write(&bits, 0, 1);
+
+  for (uint32_t n = 0; n < count && !bits.failed; n++) {
+    if (changes[n] == 0) {
+      continue;
+    }
+
+    uint32_t slot = ecs_baseline_slot(baseline, entities[n]);
+    unsigned char *sent =
+        ECS_OFFSET(baseline->values, baseline->slot_size * slot);
+    const unsigned char *value = ECS_OFFSET(values, baseline->slot_size * n);
+    for (uint32_t i = 0; i < baseline->component_count; i++) {
+      if (changes[n] & (1u << i)) {
+        memcpy(sent + baseline->offsets[i], value + baseline->offsets[i],
+               baseline->sizes[i]);
+        baseline->present[slot] |= 1u << i;
+      }
+    }
+  }
+
+  free(values);
+  free(changes);
+  return (bits.cursor + 7) / 8;
+}
+
+// walks a delta from ecs_delta_encode. registry is NULL for a dry run that
+// only checks the delta is well formed, so nothing is applied from a bad one.
+static bool ecs_delta_read(ecs_registry_t *registry, ecs_baseline_t *baseline,
+                           const void *data, size_t size) {
+  ecs_bits_t bits = {(unsigned char *)data, size, 0, false};
+  ecs_entity_t previous = 0;
+  unsigned char scratch[DELTA_MAX_SIZE] = {0};
+
+  while (ecs_bits_read(&bits, 1) == 1) {
+    ecs_entity_t remote = ecs_bits_read_id(&bits, previous);
+    previous = remote;
+    uint32_t changed =
+        (uint32_t)ecs_bits_read(&bits, baseline->component_count);
+    if (bits.failed) {
+      return false;
+    }
+
+    ecs_entity_t entity = 0;
+    uint32_t slot = 0;
+    unsigned char *known = NULL;
+    if (registry != NULL) {
+      slot = ecs_baseline_slot(baseline, remote);
+      if (baseline->local[slot] == 0) {
+        baseline->local[slot] = ecs_entity(registry);
+      }
+      entity = baseline->local[slot];
+      known = ECS_OFFSET(baseline->values, baseline->slot_size * slot);
+    }
+
+    for (uint32_t i = 0; i < baseline->component_count; i++) {
+      if (!(changed & (1u << i))) {
+        continue;
+      }
+
+      size_t component_size = baseline->sizes[i];
+      unsigned char *value =
+          registry != NULL ? known + baseline->offsets[i] : scratch;
+      uint32_t words = (uint32_t)((component_size + 3) / 4);
+      uint32_t word_mask = 0;
+      for (uint32_t w = 0; w < words; w++) {
+        word_mask |= (uint32_t)ecs_bits_read(&bits, 1) << w;
+      }
+      for (uint32_t w = 0; w < words; w++) {
+        if (word_mask & (1u << w)) {
+          uint32_t length = (uint32_t)ecs_bits_read(&bits, 5) + 1;
+          uint32_t word;
+          memcpy(&word, value + w * 4, 4);
+          word ^= (uint32_t)ecs_bits_read(&bits, length);
+          memcpy(value + w * 4, &word, 4);
+        }
+      }
+      if (bits.failed) {
+        return false;
+      }
+
+      if (registry == NULL) {
+        continue;
+      }
+      if (!(baseline->present[slot] & (1u << i))) {
+        ecs_attach(registry, entity, baseline->components[i]);
+        baseline->present[slot] |= 1u << i;
+      }
+      ecs_set(registry, entity, baseline->components[i], value);
+    }
+  }
+  return !bits.failed;
+}
+
+// applies a delta from ecs_delta_encode. entities seen for the first time are
+// created, and components are attached as they first arrive. returns false,
+// having changed nothing, if the delta is truncated or malformed.
+bool ecs_delta_decode(ecs_registry_t *registry, ecs_baseline_t *baseline,
+                      const void *data, size_t size) {
+  if (!ecs_delta_read(NULL, baseline, data, size)) {
+    return false;
+  }
+  return ecs_delta_read(registry, baseline, data, size);
+}
+
+// interest management picks, per observer, the entities worth passing to
+// ecs_delta_encode. archetypes are skipped when none of the interest's columns
+// changed since the observer's last collect, and, for spatial observers, when
+// the bounds of their positions are out of range. bounds are cached per
+// archetype and shared by every observer, so they are only recomputed after the
+// position column changes. column ticks only say a column may have been
+// written somewhere, so the columns whose ticks moved are compared with a copy
+// kept per archetype. a row is stamped with the collect that found it
+// different, and each observer gets the rows stamped since its last collect.
+// observers also keep the entities they were given, and mark those that fail
+// their checks again, sit in a culled archetype or were taken away by a
+// rollback as left, until ecs_interest_left hands them out.
+
+// positions start with float x and y, split or not
+static void ecs_ensure_position(const ecs_registry_t *registry,
+                                ecs_entity_t position) {
+  const ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)position);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(info->size >= 2 * sizeof(float), OUT_OF_BOUNDS);
+  // split positions are read from the first two field arrays, which have to
+  // hold the floats a plain one has at offsets 0 and 4
+  ECS_ENSURE(info->field_count == 0 ||
+                 (info->field_count >= 2 && info->fields[0].offset == 0 &&
+                  info->fields[0].size == sizeof(float) &&
+                  info->fields[1].offset == sizeof(float) &&
+                  info->fields[1].size == sizeof(float)),
+             "position must start with two float fields");
+}
+
+// an entity an observer was given, and the query archetype it was found in
+typedef struct ecs_relevant_t {
+  ecs_entity_t entity;
+  uint32_t index;
+  bool left; // not relevant anymore, waiting for ecs_interest_left
+} ecs_relevant_t;
+
+typedef struct ecs_observer_t {
+  bool spatial;
+  float x;
+  float y;
+  float radius;
+  ecs_relevant_fn filter;
+  void *ctx;
+  uint64_t seen_tick;  // change tick of the last collect
+  uint64_t seen_epoch; // interest epoch of the last collect
+  bool moved;          // relevance changed, so return every relevant row
+  ecs_map_t *relevant; // <ecs_entity_t, ecs_relevant_t>
+  uint32_t left_count;
+} ecs_observer_t;
+
+// the interest's columns of one query archetype as of the last compare
+typedef struct ecs_interest_rows_t {
+  uint64_t compared_at; // registry change tick of the last compare
+  uint32_t count;
+  uint32_t capacity;
+  ecs_entity_t *entity_ids;
+  uint64_t *changed; // epoch of the collect that last found the row different
+  unsigned char *values; // row_size bytes per row
+} ecs_interest_rows_t;
+
+struct ecs_interest_t {
+  ecs_registry_t *registry;
+  ecs_query_t query;
+  int32_t position; // signature index, or -1
+  uint32_t observer_count;
+  uint32_t observer_capacity;
+  ecs_observer_t *observers;
+  uint32_t bounds_count; // query archetypes when the bounds were last laid out
+  uint32_t bounds_capacity;
+  float *bounds; // min x, min y, max x, max y per query archetype
+  uint64_t *bounds_at;
+  uint64_t *culled_at;       // epoch of the last collect that culled it
+  ecs_interest_rows_t *rows; // per query archetype
+  uint64_t epoch;            // collects so far
+  size_t row_size;           // the signature's component sizes summed
+  unsigned char *scratch;    // one row being compared
+};
+
+ecs_interest_t *ecs_interest(ecs_registry_t *registry,
+                             ecs_signature_t *signature,
+                             ecs_entity_t position) {
+  ecs_interest_t *interest = ecs_malloc(sizeof(ecs_interest_t));
+  interest->registry = registry;
+  interest->position = -1;
+  for (uint32_t i = 0; i < signature->count; i++) {
+    if (position != 0 && signature->components[i] == position) {
+      interest->position = i;
+    }
+  }
+  ECS_ENSURE(position == 0 || interest->position != -1,
+             "position component is not in the signature");
+  if (position != 0) {
+    ecs_ensure_position(registry, position);
+  }
+
+  interest->row_size = 0;
+  for (uint32_t i = 0; i < signature->count; i++) {
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)signature->components[i]);
+    ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+    interest->row_size += info->size;
+  }
+
+  ecs_query_init(&interest->query, signature);
+  interest->query.sorted = registry->deterministic;
+  interest->observer_count = 0;
+  interest->observer_capacity = 0;
+  interest->observers = NULL;
+  interest->bounds_count = 0;
+  interest->bounds_capacity = 0;
+  interest->bounds = NULL;
+  interest->bounds_at = NULL;
+  interest->culled_at = NULL;
+  interest->rows = NULL;
+  interest->epoch = 0;
+  interest->scratch = ecs_malloc(interest->row_size + 1);
+  return interest;
+}
+
+void ecs_interest_free(ecs_interest_t *interest) {
+  for (uint32_t i = 0; i < interest->bounds_capacity; i++) {
+    free(interest->rows[i].entity_ids);
+    free(interest->rows[i].changed);
+    free(interest->rows[i].values);
+  }
+  for (uint32_t i = 0; i < interest->observer_count; i++) {
+    ecs_map_free(interest->observers[i].relevant);
+  }
+  ecs_query_fini(&interest->query);
+  free(interest->observers);
+  free(interest->bounds);
+  free(interest->bounds_at);
+  free(interest->culled_at);
+  free(interest->rows);
+  free(interest->scratch);
+  free(interest);
+}
+
+uint32_t ecs_interest_observer(ecs_interest_t *interest) {
+  if (interest->observer_count == interest->observer_capacity) {
+    interest->observer_capacity = interest->observer_capacity == 0
+                                      ? 4
+                                      : interest->observer_capacity * 2;
+    ecs_realloc((void **)&interest->observers,
+                sizeof(ecs_observer_t) * interest->observer_capacity);
+  }
+
+  interest->observers[interest->observer_count] = (ecs_observer_t){
+      .spatial = false,
+      .filter = NULL,
+      .seen_tick = 0,
+      .seen_epoch = 0,
+      .moved = true,
+      .relevant = ECS_MAP(intptr, ecs_entity_t, ecs_relevant_t, 16),
+      .left_count = 0};
+  return interest->observer_count++;
+}
+
+void ecs_interest_radius(ecs_interest_t *interest, uint32_t observer, float x,
+                         float y, float radius) {
+  ECS_ENSURE(observer < interest->observer_count, OUT_OF_BOUNDS);
+  ECS_ENSURE(interest->position != -1, "interest has no position component");
+  ecs_observer_t *obs = &interest->observers[observer];
+  if (!obs->spatial || obs->x != x || obs->y != y || obs->radius != radius) {
+    obs->spatial = true;
+    obs->x = x;
+    obs->y = y;
+    obs->radius = radius;
+    obs->moved = true;
+  }
+}
+
+void ecs_interest_filter(ecs_interest_t *interest, uint32_t observer,
+                         ecs_relevant_fn filter, void *ctx) {
+  ECS_ENSURE(observer < interest->observer_count, OUT_OF_BOUNDS);
+  ecs_observer_t *obs = &interest->observers[observer];
+  obs->filter = filter;
+  obs->ctx = ctx;
+  obs->moved = true;
+}
+
+// call when whatever a filter reads outside the registry has changed
+void ecs_interest_refresh(ecs_interest_t *interest, uint32_t observer) {
+  ECS_ENSURE(observer < interest->observer_count, OUT_OF_BOUNDS);
+  interest->observers[observer].moved = true;
+}
+
+static inline void ecs_view_xy(ecs_view_t view, uint32_t row, uint32_t column,
+                               float *x, float *y) {
+  if (view.component_fields[column] != NULL) {
+    *x = *(float *)ecs_view_field(view, row, column, 0);
+    *y = *(float *)ecs_view_field(view, row, column, 1);
+  } else {
+    const float *p = ecs_view(view, row, column);
+    *x = p[0];
+    *y = p[1];
+  }
+}
+
+static const float *ecs_interest_bounds(ecs_interest_t *interest,
+                                        uint32_t index) {
+  const ecs_archetype_t *archetype = interest->query.archetypes[index];
+  uint32_t column =
+      interest->query.columns[index * interest->query.sig->count +
+                              interest->position];
+  float *bounds = &interest->bounds[index * 4];
+  if (interest->bounds_at[index] >= archetype->changed[column] &&
+      interest->bounds_at[index] >= archetype->rows_changed) {
+    return bounds;
+  }
+
+  ecs_view_t view = ecs_query_view(&interest->query, index);
+  bounds[0] = bounds[1] = INFINITY;
+  bounds[2] = bounds[3] = -INFINITY;
+  for (uint32_t row = 0; row < archetype->count; row++) {
+    float x, y;
+    ecs_view_xy(view, row, interest->position, &x, &y);
+    bounds[0] = x < bounds[0] ? x : bounds[0];
+    bounds[1] = y < bounds[1] ? y : bounds[1];
+    bounds[2] = x > bounds[2] ? x : bounds[2];
+    bounds[3] = y > bounds[3] ? y : bounds[3];
+  }
+  interest->bounds_at[index] = interest->registry->change_tick;
+  return bounds;
+}
+
+static bool ecs_interest_stale(const ecs_interest_t *interest, uint32_t index,
+                               uint64_t since) {
+  const ecs_archetype_t *archetype = interest->query.archetypes[index];
+  if (archetype->rows_changed > since) {
+    return true;
+  }
+
+  const uint32_t *columns =
+      &interest->query.columns[index * interest->query.sig->count];
+  for (uint32_t i = 0; i < interest->query.sig->count; i++) {
+    if (archetype->changed[columns[i]] > since) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// stamps the rows whose entity or interest columns differ from the copy. only
+// the columns written since the last compare are read, unless rows moved.
+static void ecs_interest_compare(ecs_interest_t *interest, uint32_t index) {
+  const ecs_registry_t *registry = interest->registry;
+  const ecs_query_t *query = &interest->query;
+  const ecs_archetype_t *archetype = query->archetypes[index];
+  ecs_interest_rows_t *rows = &interest->rows[index];
+  if (rows->compared_at != 0 &&
+      !ecs_interest_stale(interest, index, rows->compared_at)) {
+    return;
+  }
+
+  if (rows->capacity < archetype->count) {
+    rows->capacity = archetype->capacity;
+    ecs_realloc((void **)&rows->entity_ids,
+                sizeof(ecs_entity_t) * rows->capacity);
+    ecs_realloc((void **)&rows->changed, sizeof(uint64_t) * rows->capacity);
+    ecs_realloc((void **)&rows->values,
+                interest->row_size * rows->capacity + 1);
+  }
+
+  bool moved = rows->compared_at == 0 ||
+               archetype->rows_changed > rows->compared_at;
+  for (uint32_t row = 0; moved && row < archetype->count; row++) {
+    if (row >= rows->count ||
+        rows->entity_ids[row] != archetype->entity_ids[row]) {
+      rows->entity_ids[row] = archetype->entity_ids[row];
+      rows->changed[row] = interest->epoch;
+    }
+  }
+
+  const uint32_t *columns = &query->columns[index * query->sig->count];
+  size_t offset = 0;
+  for (uint32_t i = 0; i < query->sig->count; i++) {
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)query->sig->components[i]);
+    uint32_t column = columns[i];
+    if (info->size == 0 ||
+        (!moved && archetype->changed[column] <= rows->compared_at)) {
+      offset += info->size;
+      continue;
+    }
+
+    for (uint32_t row = 0; row < archetype->count; row++) {
+      unsigned char *value = interest->scratch;
+      if (ecs_column_cold(archetype, column)) {
+        memcpy(value, ecs_cold_row(&archetype->cold[column], row), info->size);
+      } else {
+        ecs_column_read(info, archetype->components[column],
+                        archetype->capacity, row, value);
+      }
+
+      unsigned char *copy =
+          ECS_OFFSET(rows->values, interest->row_size * row + offset);
+      if (memcmp(copy, value, info->size) != 0) {
+        memcpy(copy, value, info->size);
+        rows->changed[row] = interest->epoch;
+      }
+    }
+    offset += info->size;
+  }
+  rows->count = archetype->count;
+  rows->compared_at = registry->change_tick;
+}
+
+static inline bool ecs_observer_sees(const ecs_observer_t *obs, float x,
+                                     float y) {
+  float dx = x - obs->x;
+  float dy = y - obs->y;
+  return dx * dx + dy * dy <= obs->radius * obs->radius;
+}
+
+// writes the entities that are relevant to the observer and changed since its
+// last collect, and returns how many there are. if they do not fit, nothing is
+// consumed and the next collect returns them again.
+uint32_t ecs_interest_collect(ecs_interest_t *interest, uint32_t observer,
+                              ecs_entity_t *out, uint32_t capacity) {
+  ECS_ENSURE(observer < interest->observer_count, OUT_OF_BOUNDS);
+  ecs_observer_t *obs = &interest->observers[observer];
+  const ecs_registry_t *registry = interest->registry;
+  ecs_query_t *query = &interest->query;
+
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  if (interest->bounds_count != query->count) {
+    if (interest->bounds_capacity < query->count) {
+      uint32_t old_capacity = interest->bounds_capacity;
+      interest->bounds_capacity = query->capacity;
+      ecs_realloc((void **)&interest->bounds,
+                  sizeof(float) * 4 * interest->bounds_capacity);
+      ecs_realloc((void **)&interest->bounds_at,
+                  sizeof(uint64_t) * interest->bounds_capacity);
+      ecs_realloc((void **)&interest->culled_at,
+                  sizeof(uint64_t) * interest->bounds_capacity);
+      ecs_realloc((void **)&interest->rows, sizeof(ecs_interest_rows_t) *
+                                                interest->bounds_capacity);
+      memset(&interest->rows[old_capacity], 0,
+             sizeof(ecs_interest_rows_t) *
+                 (interest->bounds_capacity - old_capacity));
+    }
+    // sorted queries insert archetypes in the middle, so start over. the row
+    // buffers are only storage and stay with their slot, and observers look at
+    // every row again, as the archetypes they remember moved.
+    uint32_t from = query->sorted ? 0 : interest->bounds_count;
+    memset(&interest->bounds_at[from], 0,
+           sizeof(uint64_t) * (query->count - from));
+    memset(&interest->culled_at[from], 0,
+           sizeof(uint64_t) * (query->count - from));
+    for (uint32_t i = from; i < query->count; i++) {
+      interest->rows[i].compared_at = 0;
+      interest->rows[i].count = 0;
+    }
+    for (uint32_t i = 0; query->sorted && i < interest->observer_count; i++) {
+      interest->observers[i].moved = true;
+    }
+    interest->bounds_count = query->count;
+  }
+  interest->epoch++;
+
+  uint32_t count = 0;
+  bool sweep = obs->moved;
+  for (uint32_t i = 0; i < query->count; i++) {
+    const ecs_archetype_t *archetype = query->archetypes[i];
+    if (!obs->moved && !ecs_interest_stale(interest, i, obs->seen_tick)) {
+      continue;
+    }
+    sweep = true;
+    if (archetype->count == 0) {
+      continue;
+    }
+
+    if (obs->spatial) {
+      const float *bounds = ecs_interest_bounds(interest, i);
+      float x = obs->x < bounds[0]   ? bounds[0]
+                : obs->x > bounds[2] ? bounds[2]
+                                     : obs->x;
+      float y = obs->y < bounds[1]   ? bounds[1]
+                : obs->y > bounds[3] ? bounds[3]
+                                     : obs->y;
+      if (!ecs_observer_sees(obs, x, y)) {
+        interest->culled_at[i] = interest->epoch;
+        continue;
+      }
+    }
+
+    ecs_interest_compare(interest, i);
+    const uint64_t *changed = interest->rows[i].changed;
+    ecs_view_t view = ecs_query_view(query, i);
+    for (uint32_t row = 0; row < archetype->count; row++) {
+      if (!obs->moved && changed[row] <= obs->seen_epoch) {
+        continue;
+      }
+      ecs_entity_t entity = archetype->entity_ids[row];
+      ecs_relevant_t *relevant = ecs_map_get(obs->relevant, (void *)entity);
+      float x, y;
+      if (obs->spatial) {
+        ecs_view_xy(view, row, interest->position, &x, &y);
+      }
+      if ((obs->spatial && !ecs_observer_sees(obs, x, y)) ||
+          (obs->filter != NULL && !obs->filter(view, row, obs->ctx))) {
+        if (relevant != NULL && !relevant->left) {
+          relevant->left = true;
+          obs->left_count++;
+        }
+        continue;
+      }
+
+      if (relevant == NULL) {
+        ecs_map_set(obs->relevant, (void *)entity,
+                    &(ecs_relevant_t){entity, i, false});
+      } else {
+        obs->left_count -= relevant->left;
+        relevant->index = i;
+        relevant->left = false;
+      }
+      if (count < capacity) {
+        out[count] = archetype->entity_ids[row];
+      }
+      count++;
+    }
+  }
+
+  // entities that were not looked at above are still where they were found,
+  // unless a rollback took them away, they moved or their archetype was culled
+  ecs_relevant_t *relevant = ecs_map_values(obs->relevant);
+  for (uint32_t i = 0; sweep && i < ecs_map_len(obs->relevant); i++) {
+    const ecs_record_t *record =
+        ecs_map_get(registry->entity_index, (void *)relevant[i].entity);
+    if (!relevant[i].left &&
+        (record == NULL || relevant[i].index >= query->count ||
+         query->archetypes[relevant[i].index] != record->archetype ||
+         interest->culled_at[relevant[i].index] == interest->epoch)) {
+      relevant[i].left = true;
+      obs->left_count++;
+    }
+  }
+
+  if (count <= capacity) {
+    obs->seen_tick = registry->change_tick;
+    obs->seen_epoch = interest->epoch;
+    obs->moved = false;
+  }
+  return count;
+}
+
+// writes the entities that stopped being relevant to the observer as of its
+// last collect, and returns how many there are. like collect, nothing is
+// consumed if they do not fit. an entity that becomes relevant again before
+// this is called is returned by collect instead.
+uint32_t ecs_interest_left(ecs_interest_t *interest, uint32_t observer,
+                           ecs_entity_t *out, uint32_t capacity) {
+  ECS_ENSURE(observer < interest->observer_count, OUT_OF_BOUNDS);
+  ecs_observer_t *obs = &interest->observers[observer];
+  uint32_t count = obs->left_count;
+  if (count == 0 || count > capacity) {
+    return count;
+  }
+
+  // backwards, as removing moves the last entry into the removed one's place
+  ecs_relevant_t *relevant = ecs_map_values(obs->relevant);
+  uint32_t written = 0;
+  for (uint32_t i = ecs_map_len(obs->relevant); i-- > 0;) {
+    if (relevant[i].left) {
+      out[written++] = relevant[i].entity;
+      ecs_map_remove(obs->relevant, (void *)relevant[i].entity);
+    }
+  }
+  obs->left_count = 0;
+  return count;
+}
+
+// rollback keeps the last few states of the registry in a ring. a snapshot
+// holds a copy of every archetype's rows and of the entity index. saving and
+// restoring both use change ticks to skip the columns that already match, so
+// components nobody writes cost nothing after the first save. a snapshot also
+// keeps each system's timing and cursors, so resimulated steps run the same
+// systems over the same rows; the systems themselves must stay registered.
+
+typedef struct ecs_archetype_copy_t {
+  uint64_t saved_at; // registry change tick when the copy was made
+  uint32_t count;
+  uint32_t capacity; // rows the buffers hold, split fields are this far apart
+  uint32_t column_count;
+  ecs_entity_t *entity_ids;
+  void **components;
+} ecs_archetype_copy_t;
+
+typedef struct ecs_system_state_t {
+  ecs_entity_t id;
+  double accumulator;
+  double since_run;
+  uint32_t cursor_archetype;
+  uint32_t cursor_row;
+  uint32_t stride_offset;
+} ecs_system_state_t;
+
+typedef struct ecs_snapshot_t {
+  bool used;
+  uint64_t tick;
+  uint64_t change_tick;
+  ecs_entity_t next_entity_id;
+  uint32_t system_count;
+  uint32_t system_capacity;
+  ecs_system_state_t *systems;
+  uint32_t archetype_count;
+  ecs_archetype_copy_t *archetypes; // in type index order
+  ecs_map_t *entity_index;
+  uint64_t index_saved_at;
+} ecs_snapshot_t;
+
+struct ecs_rollback_t {
+  ecs_registry_t *registry;
+  uint32_t size;
+  ecs_snapshot_t *snapshots;
+};
+
+ecs_rollback_t *ecs_rollback(ecs_registry_t *registry, uint32_t size) {
+  ECS_ENSURE(size > 0, OUT_OF_BOUNDS);
+  ecs_rollback_t *rollback = ecs_malloc(sizeof(ecs_rollback_t));
+  rollback->registry = registry;
+  rollback->size = size;
+  rollback->snapshots = ecs_calloc(sizeof(ecs_snapshot_t), size);
+  for (uint32_t i = 0; i < size; i++) {
+    rollback->snapshots[i].entity_index =
+        ECS_MAP(intptr, ecs_entity_t, ecs_record_t, 16);
+  }
+  return rollback;
+}
+
+void ecs_rollback_free(ecs_rollback_t *rollback) {
+  for (uint32_t i = 0; i < rollback->size; i++) {
+    ecs_snapshot_t *snapshot = &rollback->snapshots[i];
+    for (uint32_t j = 0; j < snapshot->archetype_count; j++) {
+      ecs_archetype_copy_t *copy = &snapshot->archetypes[j];
+      for (uint32_t k = 0; k < copy->column_count; k++) {
+        free(copy->components[k]);
+      }
+      free(copy->components);
+      free(copy->entity_ids);
+    }
+    free(snapshot->archetypes);
+    free(snapshot->systems);
+    ecs_map_free(snapshot->entity_index);
+  }
+  free(rollback->snapshots);
+  free(rollback);
+}
+
+static void ecs_archetype_save(const ecs_registry_t *registry,
+                               const ecs_archetype_t *archetype,
+                               ecs_archetype_copy_t *copy) {
+  bool rows_match = copy->saved_at >= archetype->rows_changed;
+  if (copy->capacity < archetype->count) {
+    copy->capacity = archetype->count;
+    ecs_realloc((void **)&copy->entity_ids,
+                sizeof(ecs_entity_t) * copy->capacity);
+    rows_match = false;
+  }
+  if (!rows_match && archetype->count != 0) {
+    memcpy(copy->entity_ids, archetype->entity_ids,
+           sizeof(ecs_entity_t) * archetype->count);
+  }
+
+  for (uint32_t i = 0; i < copy->column_count; i++) {
+    // rows moving leaves every column changed, and split fields are laid out
+    // by capacity, so a grown copy is rewritten too
+    if (archetype->count == 0 ||
+        (rows_match && copy->saved_at >= archetype->changed[i])) {
+      continue;
+    }
+
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)archetype->type->elements[i]);
+    if (info->size == 0) {
+      continue;
+    }
+    ecs_realloc(&copy->components[i], info->size * copy->capacity);
+    if (ecs_column_cold(archetype, i)) {
+      ecs_cold_unpack(&archetype->cold[i], copy->components[i]);
+      continue;
+    }
+    ecs_column_append(info, copy->components[i], copy->capacity, 0,
+                      archetype->components[i], archetype->capacity,
+                      archetype->count);
+  }
+
+  copy->count = archetype->count;
+  copy->saved_at = registry->change_tick;
+}
+
+// saves the current state as the given tick, replacing the oldest snapshot
+void ecs_rollback_save(ecs_rollback_t *rollback, uint64_t tick) {
+  const ecs_registry_t *registry = rollback->registry;
+  ecs_snapshot_t *snapshot = &rollback->snapshots[tick % rollback->size];
+
+  uint32_t archetype_count = ecs_map_len(registry->type_index);
+  ecs_archetype_t **archetypes = ecs_map_values(registry->type_index);
+  if (snapshot->archetype_count < archetype_count) {
+    ecs_realloc((void **)&snapshot->archetypes,
+                sizeof(ecs_archetype_copy_t) * archetype_count);
+    for (uint32_t i = snapshot->archetype_count; i < archetype_count; i++) {
+      uint32_t column_count = ecs_type_len(archetypes[i]->type);
+      snapshot->archetypes[i] = (ecs_archetype_copy_t){
+          .column_count = column_count,
+          .components = ecs_calloc(sizeof(void *), column_count + 1)};
+    }
+    snapshot->archetype_count = archetype_count;
+  }
+
+  uint64_t rows_changed = 0;
+  for (uint32_t i = 0; i < archetype_count; i++) {
+    ecs_archetype_save(registry, archetypes[i], &snapshot->archetypes[i]);
+    if (archetypes[i]->rows_changed > rows_changed) {
+      rows_changed = archetypes[i]->rows_changed;
+    }
+  }
+
+  if (!snapshot->used || snapshot->index_saved_at < rows_changed) {
+    ecs_map_copy(snapshot->entity_index, registry->entity_index);
+    snapshot->index_saved_at = registry->change_tick;
+  }
+
+  snapshot->used = true;
+  snapshot->tick = tick;
+  snapshot->change_tick = registry->change_tick;
+  snapshot->next_entity_id = registry->definitions->next_entity_id;
+
+  uint32_t system_count = ecs_map_len(registry->system_index);
+  if (snapshot->system_capacity < system_count) {
+    snapshot->system_capacity = system_count;
+    ecs_realloc((void **)&snapshot->systems,
+                sizeof(ecs_system_state_t) * system_count);
+  }
+  const ecs_system_t *systems = ecs_map_values(registry->system_index);
+  for (uint32_t i = 0; i < system_count; i++) {
+    snapshot->systems[i] = (ecs_system_state_t){
+        .id = systems[i].id,
+        .accumulator = systems[i].accumulator,
+        .since_run = systems[i].since_run,
+        .cursor_archetype = systems[i].cursor_archetype,
+        .cursor_row = systems[i].cursor_row,
+        .stride_offset = systems[i].stride_offset};
+  }
+  snapshot->system_count = system_count;
+}
+
+static void ecs_archetype_load(ecs_registry_t *registry,
+                               ecs_archetype_t *archetype,
+                               const ecs_archetype_copy_t *copy,
+                               uint64_t since) {
+  bool rows_changed = archetype->rows_changed > since;
+  if (rows_changed) {
+    // every column is rewritten, or left empty
+    ecs_archetype_inflate(archetype);
+    if (copy->count != 0) {
+      ecs_archetype_reserve(archetype, registry->component_index, copy->count);
+      memcpy(archetype->entity_ids, copy->entity_ids,
+             sizeof(ecs_entity_t) * copy->count);
+    }
+    archetype->count = copy->count;
+    archetype->rows_changed = ++registry->change_tick;
+  }
+
+  for (uint32_t i = 0; i < copy->column_count; i++) {
+    if (copy->count == 0 ||
+        (!rows_changed && archetype->changed[i] <= since)) {
+      continue;
+    }
+
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)archetype->type->elements[i]);
+    if (info->size == 0) {
+      continue;
+    }
+    ecs_column_inflate(archetype, i);
+    ecs_column_append(info, archetype->components[i], archetype->capacity, 0,
+                      copy->components[i], copy->capacity, copy->count);
+    if (archetype->front[i] != NULL) {
+      memcpy(archetype->front[i], archetype->components[i],
+             ecs_column_row_size(info) * archetype->capacity);
+    }
+    ecs_archetype_touch_column(registry, archetype, i);
+  }
+}
+
+// puts the registry back in the state saved for tick. returns false if that
+// tick is no longer in the ring.
+bool ecs_rollback_restore(ecs_rollback_t *rollback, uint64_t tick) {
+  ecs_registry_t *registry = rollback->registry;
+  ecs_ensure_structural(registry);
+  ecs_snapshot_t *snapshot = &rollback->snapshots[tick % rollback->size];
+  if (!snapshot->used || snapshot->tick != tick) {
+    return false;
+  }
+  ECS_ENSURE(ecs_map_len(registry->system_index) == snapshot->system_count,
+             "systems changed since the snapshot");
+  for (uint32_t i = 0; i < snapshot->system_count; i++) {
+    ECS_ENSURE(ecs_map_get(registry->system_index,
+                           (void *)snapshot->systems[i].id) != NULL,
+               "systems changed since the snapshot");
+  }
+
+  uint32_t archetype_count = ecs_map_len(registry->type_index);
+  ecs_archetype_t **archetypes = ecs_map_values(registry->type_index);
+  uint64_t since = snapshot->change_tick;
+  bool rows_changed = false;
+  for (uint32_t i = 0; i < archetype_count; i++) {
+    ecs_archetype_t *archetype = archetypes[i];
+    rows_changed = rows_changed || archetype->rows_changed > since;
+    if (i < snapshot->archetype_count) {
+      ecs_archetype_load(registry, archetype, &snapshot->archetypes[i], since);
+    } else if (archetype->count != 0) {
+      // created after the snapshot
+      ecs_archetype_inflate(archetype);
+      archetype->count = 0;
+      archetype->rows_changed = ++registry->change_tick;
+    }
+  }
+
+  if (rows_changed) {
+    ecs_map_copy(registry->entity_index, snapshot->entity_index);
+    registry->epoch++;
+  }
+  if (registry->definitions->refs == 1) {
+    registry->definitions->next_entity_id = snapshot->next_entity_id;
+  }
+
+  for (uint32_t i = 0; i < snapshot->system_count; i++) {
+    const ecs_system_state_t *state = &snapshot->systems[i];
+    ecs_system_t *sys = ecs_map_get(registry->system_index, (void *)state->id);
+    sys->accumulator = state->accumulator;
+    sys->since_run = state->since_run;
+    sys->cursor_archetype = state->cursor_archetype;
+    sys->cursor_row = state->cursor_row;
+    sys->stride_offset = state->stride_offset;
+  }
+  return true;
+}
+
+// restores tick from, then steps up to tick to, calling input before each
+// step and saving each tick reached along the way
+bool ecs_resimulate(ecs_rollback_t *rollback, uint64_t from, uint64_t to,
+                    float delta_time, ecs_input_fn input, void *ctx) {
+  ECS_ENSURE(from <= to, OUT_OF_BOUNDS);
+  if (!ecs_rollback_restore(rollback, from)) {
+    return false;
+  }
+
+  for (uint64_t tick = from; tick < to; tick++) {
+    if (input != NULL) {
+      input(rollback->registry, tick, ctx);
+    }
+    ecs_step_delta(rollback->registry, delta_time);
+    ecs_rollback_save(rollback, tick + 1);
+  }
+  return true;
+}
+
+// a spatial hash over a position component, for proximity queries. entities
+// are bucketed by grid cell, and the index catches up before each query: only
+// archetypes whose position column or rows changed since they were last
+// indexed are rescanned.
+
+typedef struct ecs_spatial_item_t {
+  ecs_entity_t entity;
+  float x;
+  float y;
+} ecs_spatial_item_t;
+
+typedef struct ecs_spatial_cell_t {
+  uint32_t count;
+  uint32_t capacity;
+  ecs_spatial_item_t *items;
+} ecs_spatial_cell_t;
+
+typedef struct ecs_spatial_slot_t {
+  ecs_entity_t entity;
+  uint32_t cell;
+  uint32_t row;  // within the cell
+  uint64_t seen; // the last update that found the entity
+} ecs_spatial_slot_t;
+
+struct ecs_spatial_t {
+  ecs_registry_t *registry;
+  ecs_entity_t position;
+  float cell_size;
+  ecs_query_t query;
+  ecs_map_t *indexed_at; // <ecs_archetype_t *, uint64_t>
+  ecs_map_t *cell_index; // <uintptr_t, uint32_t>
+  uint32_t cell_count;
+  uint32_t cell_capacity;
+  ecs_spatial_cell_t *cells;
+  ecs_map_t *slots; // <ecs_entity_t, ecs_spatial_slot_t>
+  uint64_t updates;
+};
+
+ecs_spatial_t *ecs_spatial(ecs_registry_t *registry, ecs_entity_t position,
+                           float cell_size) {
+  ECS_ENSURE(cell_size > 0.0f, OUT_OF_BOUNDS);
+  ecs_ensure_position(registry, position);
+
+  ecs_spatial_t *spatial = ecs_malloc(sizeof(ecs_spatial_t));
+  spatial->registry = registry;
+  spatial->position = position;
+  spatial->cell_size = cell_size;
+  ecs_query_init(&spatial->query, ecs_signature_new_n(1, position));
+  spatial->indexed_at = ECS_MAP(intptr, ecs_archetype_t *, uint64_t, 16);
+  spatial->cell_index = ECS_MAP(intptr, uintptr_t, uint32_t, 64);
+  spatial->cell_count = 0;
+  spatial->cell_capacity = 0;
+  spatial->cells = NULL;
+  spatial->slots = ECS_MAP(intptr, ecs_entity_t, ecs_spatial_slot_t, 64);
+  spatial->updates = 0;
+  return spatial;
+}
+
+void ecs_spatial_free(ecs_spatial_t *spatial) {
+  ecs_query_fini(&spatial->query);
+  ecs_map_free(spatial->indexed_at);
+  ecs_map_free(spatial->cell_index);
+  for (uint32_t i = 0; i < spatial->cell_count; i++) {
+    free(spatial->cells[i].items);
+  }
+  free(spatial->cells);
+  ecs_map_free(spatial->slots);
+  free(spatial);
+}
+
+static inline int32_t ecs_spatial_coord(const ecs_spatial_t *spatial,
+                                        float value) {
+  float scaled = value / spatial->cell_size;
+  // far off and NaN coordinates share the outermost cells
+  if (!(scaled > (float)INT32_MIN)) {
+    return INT32_MIN;
+  }
+  if (scaled >= (float)INT32_MAX) {
+    return INT32_MAX;
+  }
+  int32_t truncated = (int32_t)scaled;
+  return truncated - (scaled < (float)truncated);
+}
+
+// on 32-bit targets different cells can share a key, which only costs time,
+// since queries test every item they visit
+static inline uintptr_t ecs_spatial_key(int32_t cx, int32_t cy) {
+  return ((uintptr_t)(uint32_t)cx << (sizeof(uintptr_t) * 4)) ^ (uint32_t)cy;
+}
+
+static uint32_t ecs_spatial_cell(ecs_spatial_t *spatial, float x, float y) {
+  uintptr_t key = ecs_spatial_key(ecs_spatial_coord(spatial, x),
+                                  ecs_spatial_coord(spatial, y));
+  uint32_t *found = ecs_map_get(spatial->cell_index, (void *)key);
+  if (found != NULL) {
+    return *found;
+  }
+
+  if (spatial->cell_count == spatial->cell_capacity) {
+    spatial->cell_capacity =
+        spatial->cell_capacity == 0 ? 64 : spatial->cell_capacity * 2;
+    ecs_realloc((void **)&spatial->cells,
+                sizeof(ecs_spatial_cell_t) * spatial->cell_capacity);
+  }
+
+  uint32_t cell = spatial->cell_count++;
+  spatial->cells[cell] = (ecs_spatial_cell_t){0, 0, NULL};
+  ecs_map_set(spatial->cell_index, (void *)key, &cell);
+  return cell;
+}
+
+static void ecs_spatial_unlink(ecs_spatial_t *spatial,
+                               const ecs_spatial_slot_t *slot) {
+  ecs_spatial_cell_t *cell = &spatial->cells[slot->cell];
+  ecs_spatial_item_t *last = &cell->items[--cell->count];
+  if (slot->row != cell->count) {
+    cell->items[slot->row] = *last;
+    ecs_spatial_slot_t *moved =
+        ecs_map_get(spatial->slots, (void *)last->entity);
+    moved->row = slot->row;
+  }
+}
+
+static void ecs_spatial_put(ecs_spatial_t *spatial, ecs_entity_t entity,
+                            float x, float y) {
+  uint32_t cell = ecs_spatial_cell(spatial, x, y);
+  ecs_spatial_slot_t *slot = ecs_map_get(spatial->slots, (void *)entity);
+  if (slot != NULL && slot->cell == cell) {
+    ecs_spatial_item_t *item = &spatial->cells[cell].items[slot->row];
+    item->x = x;
+    item->y = y;
+    slot->seen = spatial->updates;
+    return;
+  }
+  if (slot != NULL) {
+    ecs_spatial_unlink(spatial, slot);
+  }
+
+  ecs_spatial_cell_t *to = &spatial->cells[cell];
+  if (to->count == to->capacity) {
+    to->capacity = to->capacity == 0 ? 4 : to->capacity * 2;
+    ecs_realloc((void **)&to->items, sizeof(ecs_spatial_item_t) * to->capacity);
+  }
+  to->items[to->count] = (ecs_spatial_item_t){entity, x, y};
+
+  ecs_spatial_slot_t placed = {entity, cell, to->count++, spatial->updates};
+  ecs_map_set(spatial->slots, (void *)entity, &placed);
+}
+
+// drops entities that no longer exist or no longer have the position
+static void ecs_spatial_sweep(ecs_spatial_t *spatial) {
+  const ecs_registry_t *registry = spatial->registry;
+  ecs_spatial_slot_t *slots = ecs_map_values(spatial->slots);
+
+  // removing swaps the last slot in, so walk backwards
+  for (uint32_t i = ecs_map_len(spatial->slots); i-- > 0;) {
+    if (slots[i].seen == spatial->updates) {
+      continue;
+    }
+
+    const ecs_record_t *record =
+        ecs_map_get(registry->entity_index, (void *)slots[i].entity);
+    if (record == NULL ||
+        ecs_type_index_of(record->archetype->type, spatial->position) == -1) {
+      ecs_spatial_slot_t slot = slots[i];
+      ecs_spatial_unlink(spatial, &slot);
+      ecs_map_remove(spatial->slots, (void *)slot.entity);
+    }
+  }
+}
+
+static void ecs_spatial_update(ecs_spatial_t *spatial) {
+  const ecs_registry_t *registry = spatial->registry;
+  ecs_query_t *query = &spatial->query;
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  spatial->updates++;
+
+  bool rows_changed = false;
+  for (uint32_t i = 0; i < query->count; i++) {
+    const ecs_archetype_t *archetype = query->archetypes[i];
+    uint64_t *found = ecs_map_get(spatial->indexed_at, (void *)archetype);
+    uint64_t indexed_at = found != NULL ? *found : 0;
+    if (found != NULL && archetype->rows_changed <= indexed_at &&
+        archetype->changed[query->columns[i]] <= indexed_at) {
+      continue;
+    }
+
+    rows_changed = rows_changed || archetype->rows_changed > indexed_at;
+    ecs_view_t view = ecs_query_view(query, i);
+    for (uint32_t row = 0; row < archetype->count; row++) {
+      float x, y;
+      ecs_view_xy(view, row, 0, &x, &y);
+      ecs_spatial_put(spatial, archetype->entity_ids[row], x, y);
+    }
+
+    indexed_at = registry->change_tick;
+    ecs_map_set(spatial->indexed_at, (void *)archetype, &indexed_at);
+  }
+
+  if (rows_changed) {
+    ecs_spatial_sweep(spatial);
+  }
+}
+
+static inline void ecs_spatial_visit(const ecs_spatial_cell_t *cell,
+                                     const float *box, const float *circle,
+                                     ecs_entity_t *out, uint32_t capacity,
+                                     uint32_t *count) {
+  for (uint32_t i = 0; i < cell->count; i++) {
+    const ecs_spatial_item_t *item = &cell->items[i];
+    if (item->x < box[0] || item->y < box[1] || item->x > box[2] ||
+        item->y > box[3]) {
+      continue;
+    }
+    if (circle != NULL) {
+      float dx = item->x - circle[0];
+      float dy = item->y - circle[1];
+      if (dx * dx + dy * dy > circle[2] * circle[2]) {
+        continue;
+      }
+    }
+
+    if (*count < capacity) {
+      out[*count] = item->entity;
+    }
+    (*count)++;
+  }
+}
+
+// box is min x, min y, max x, max y, and circle is x, y, radius or NULL
+static uint32_t ecs_spatial_search(ecs_spatial_t *spatial, const float *box,
+                                   const float *circle, ecs_entity_t *out,
+                                   uint32_t capacity) {
+  ecs_ensure_writable(spatial->registry);
+  ecs_spatial_update(spatial);
+
+  int32_t min_x = ecs_spatial_coord(spatial, box[0]);
+  int32_t min_y = ecs_spatial_coord(spatial, box[1]);
+  int32_t max_x = ecs_spatial_coord(spatial, box[2]);
+  int32_t max_y = ecs_spatial_coord(spatial, box[3]);
+  uint32_t count = 0;
+
+  // a box covering more cells than exist is cheaper to answer by visiting them
+  uint64_t covered = (uint64_t)(max_x - (int64_t)min_x + 1) *
+                     (uint64_t)(max_y - (int64_t)min_y + 1);
+  if (covered > spatial->cell_count) {
+    for (uint32_t i = 0; i < spatial->cell_count; i++) {
+      ecs_spatial_visit(&spatial->cells[i], box, circle, out, capacity, &count);
+    }
+    return count;
+  }
+
+  for (int64_t cy = min_y; cy <= max_y; cy++) {
+    for (int64_t cx = min_x; cx <= max_x; cx++) {
+      uint32_t *cell = ecs_map_get(
+          spatial->cell_index,
+          (void *)ecs_spatial_key((int32_t)cx, (int32_t)cy));
+      if (cell != NULL) {
+        ecs_spatial_visit(&spatial->cells[*cell], box, circle, out, capacity,
+                          &count);
+      }
+    }
+  }
+  return count;
+}
+
+// both queries write up to capacity entities and return how many matched
+uint32_t ecs_spatial_radius(ecs_spatial_t *spatial, float x, float y,
+                            float radius, ecs_entity_t *out,
+                            uint32_t capacity) {
+  float box[4] = {x - radius, y - radius, x + radius, y + radius};
+  float circle[3] = {x, y, radius};
+  return ecs_spatial_search(spatial, box, circle, out, capacity);
+}
+
+uint32_t ecs_spatial_aabb(ecs_spatial_t *spatial, float min_x, float min_y,
+                          float max_x, float max_y, ecs_entity_t *out,
+                          uint32_t capacity) {
+  float box[4] = {min_x, min_y, max_x, max_y};
+  return ecs_spatial_search(spatial, box, NULL, out, capacity);
+}
+
+// secondary indices map the value of one component field to the entities that
+// have it. values are turned into uint64_t keys that sort like the values, and
+// kept either in a hash of chains or in a sorted array.
+//
+// ecs_set and ecs_attach update an index on the spot when it was up to date
+// before them. anything else that changes the field, such as systems, is found
+// through change ticks and rescanned before the next lookup.
+//
+// sorted indices append new pairs unsorted and leave old ones behind when an
+// entity's key changes. before a lookup, or once the appended pairs outnumber
+// the sorted ones, they are radix sorted and merged in, dropping stale pairs.
+
+// in the sorting section below
+static void ecs_sort_order_radix(uint32_t *order, uint32_t *scratch,
+                                 uint32_t count, const uint64_t *keys,
+                                 size_t key_size);
+
+typedef struct ecs_index_entry_t {
+  ecs_entity_t entity;
+  uint64_t key;
+  ecs_entity_t next; // the next entity with the same hashed key, or 0
+  uint64_t seen;     // the last update that found the entity
+} ecs_index_entry_t;
+
+typedef struct ecs_index_pair_t {
+  uint64_t key;
+  ecs_entity_t entity;
+} ecs_index_pair_t;
+
+typedef struct ecs_index_sync_t {
+  uint64_t column; // change ticks of the archetype that have been indexed
+  uint64_t rows;
+} ecs_index_sync_t;
+
+struct ecs_index_t {
+  ecs_registry_t *registry;
+  ecs_entity_t component;
+  size_t offset; // of the field within the component
+  size_t size;
+  ecs_key_t kind;
+  int32_t field; // split field holding the value, or -1
+  size_t field_start;
+  bool sorted;
+  bool current;      // up to date when the running ecs_set or ecs_attach began
+  uint64_t synced;   // registry change tick everything is indexed up to
+  uint64_t updates;
+  ecs_query_t query;
+  ecs_map_t *archetype_sync; // <ecs_archetype_t *, ecs_index_sync_t>
+  ecs_map_t *entries;        // <ecs_entity_t, ecs_index_entry_t>
+  ecs_map_t *heads;          // <uintptr_t, ecs_entity_t>, hashed only
+  uint32_t pair_count;       // sorted only
+  uint32_t pair_capacity;
+  uint32_t pair_sorted; // pairs in order, the rest were appended since
+  uint32_t pair_stale;  // pairs left behind, found by their entry's key
+  ecs_index_pair_t *pairs;
+};
+
+// flips the sign bit of signed values and orders floats by their bits, so that
+// comparing keys as unsigned integers compares the values
+static uint64_t ecs_index_key(ecs_key_t kind, const void *value, size_t size) {
+  uint64_t bits = 0;
+  if (size == 1) {
+    bits = *(const uint8_t *)value;
+  } else if (size == 2) {
+    uint16_t v;
+    memcpy(&v, value, 2);
+    bits = v;
+  } else if (size == 4) {
+    uint32_t v;
+    memcpy(&v, value, 4);
+    bits = v;
+  } else {
+    memcpy(&bits, value, 8);
+  }
+
+  uint64_t sign = 1ull << (size * 8 - 1);
+  uint64_t mask = size == 8 ? ~0ull : (1ull << (size * 8)) - 1;
+  switch (kind) {
+  case ECS_KEY_UNSIGNED:
+    return bits;
+  case ECS_KEY_SIGNED:
+    return bits ^ sign;
+  case ECS_KEY_FLOAT:
+    if ((bits & ~sign & mask) == 0) {
+      bits = 0; // -0.0 is +0.0
+    }
+    return (bits & sign) ? ~bits & mask : bits | sign;
+  }
+  return bits;
+}
+
+static const void *ecs_index_value(const ecs_index_t *index,
+                                   ecs_archetype_t *archetype,
+                                   uint32_t column, uint32_t row) {
+  ecs_column_inflate(archetype, column);
+  const void *component_array = archetype->components[column];
+  const ecs_component_info_t *info =
+      ecs_map_get(index->registry->component_index, (void *)index->component);
+  if (index->field == -1) {
+    return ECS_OFFSET(component_array, info->size * row + index->offset);
+  }
+
+  const ecs_field_t *field = &info->fields[index->field];
+  return ECS_OFFSET(component_array, archetype->capacity * index->field_start +
+                                         field->size * row + index->offset -
+                                         field->offset);
+}
+
+static uint32_t ecs_index_lower_bound(const ecs_index_t *index, uint64_t key,
+                                      ecs_entity_t entity) {
+  uint32_t lo = 0, hi = index->pair_count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const ecs_index_pair_t *pair = &index->pairs[mid];
+    if (pair->key < key || (pair->key == key && pair->entity < entity)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static bool ecs_index_pair_less(ecs_index_pair_t a, ecs_index_pair_t b) {
+  return a.key < b.key || (a.key == b.key && a.entity < b.entity);
+}
+
+// a pair is stale once its entity is gone or has another key. an entity that
+// went back to an earlier key has two equal pairs, which end up side by side.
+static bool ecs_index_pair_live(const ecs_index_t *index,
+                                ecs_index_pair_t pair) {
+  const ecs_index_entry_t *entry =
+      ecs_map_get(index->entries, (void *)pair.entity);
+  return entry != NULL && entry->key == pair.key;
+}
+
+// sorts the appended pairs and merges them with the sorted ones
+static void ecs_index_merge(ecs_index_t *index) {
+  uint32_t sorted = index->pair_sorted;
+  uint32_t added = index->pair_count - sorted;
+  if (added == 0 && index->pair_stale == 0) {
+    return;
+  }
+
+  ecs_index_pair_t *tail = &index->pairs[sorted];
+  uint64_t *keys = ecs_malloc(sizeof(uint64_t) * (added + 1));
+  uint32_t *order = ecs_malloc(sizeof(uint32_t) * (added * 2 + 1));
+  for (uint32_t i = 0; i < added; i++) {
+    keys[i] = tail[i].entity;
+    order[i] = i;
+  }
+  if (added > 0) {
+    // by entity, then stably by key
+    ecs_sort_order_radix(order, order + added, added, keys, sizeof(uint64_t));
+    for (uint32_t i = 0; i < added; i++) {
+      keys[i] = tail[i].key;
+    }
+    ecs_sort_order_radix(order, order + added, added, keys, index->size);
+  }
+
+  bool check = index->pair_stale > 0;
+  ecs_index_pair_t *pairs =
+      ecs_malloc(sizeof(ecs_index_pair_t) * index->pair_capacity);
+  uint32_t a = 0, b = 0, count = 0;
+  while (a < sorted || b < added) {
+    ecs_index_pair_t next;
+    if (b == added ||
+        (a < sorted && !ecs_index_pair_less(tail[order[b]], index->pairs[a]))) {
+      next = index->pairs[a++];
+    } else {
+      next = tail[order[b++]];
+    }
+
+    bool repeated = count > 0 && pairs[count - 1].key == next.key &&
+                    pairs[count - 1].entity == next.entity;
+    if (!repeated && (!check || ecs_index_pair_live(index, next))) {
+      pairs[count++] = next;
+    }
+  }
+
+  free(index->pairs);
+  free(order);
+  free(keys);
+  index->pairs = pairs;
+  index->pair_count = count;
+  index->pair_sorted = count;
+  index->pair_stale = 0;
+}
+
+static void ecs_index_link(ecs_index_t *index, ecs_entity_t entity,
+                           ecs_index_entry_t *entry) {
+  if (index->sorted) {
+    if (index->pair_count == index->pair_capacity) {
+      index->pair_capacity =
+          index->pair_capacity == 0 ? 64 : index->pair_capacity * 2;
+      ecs_realloc((void **)&index->pairs,
+                  sizeof(ecs_index_pair_t) * index->pair_capacity);
+    }
+    index->pairs[index->pair_count++] = (ecs_index_pair_t){entry->key, entity};
+    if (index->pair_count - index->pair_sorted > index->pair_sorted + 64) {
+      ecs_index_merge(index);
+    }
+    return;
+  }
+
+  uintptr_t hashed = (uintptr_t)entry->key;
+  ecs_entity_t *head = ecs_map_get(index->heads, (void *)hashed);
+  entry->next = head != NULL ? *head : 0;
+  ecs_map_set(index->heads, (void *)hashed, &entity);
+}
+
+static void ecs_index_unlink(ecs_index_t *index, ecs_entity_t entity,
+                             const ecs_index_entry_t *entry) {
+  if (index->sorted) {
+    index->pair_stale++;
+    return;
+  }
+
+  uintptr_t hashed = (uintptr_t)entry->key;
+  ecs_entity_t *head = ecs_map_get(index->heads, (void *)hashed);
+  ECS_ASSERT(head != NULL, SOMETHING_TERRIBLE);
+  if (*head == entity) {
+    if (entry->next == 0) {
+      ecs_map_remove(index->heads, (void *)hashed);
+    } else {
+      *head = entry->next;
+    }
+    return;
+  }
+
+  ecs_index_entry_t *prev = ecs_map_get(index->entries, (void *)*head);
+  while (prev->next != entity) {
+    prev = ecs_map_get(index->entries, (void *)prev->next);
+  }
+  prev->next = entry->next;
+}
+
+// indexes the entity's value, or reindexes it if the value changed
+static void ecs_index_put(ecs_index_t *index, ecs_entity_t entity,
+                          ecs_archetype_t *archetype, uint32_t column,
+                          uint32_t row) {
+  uint64_t key = ecs_index_key(
+      index->kind, ecs_index_value(index, archetype, column, row), index->size);
+  ecs_index_entry_t *entry = ecs_map_get(index->entries, (void *)entity);
+  if (entry != NULL) {
+    entry->seen = index->updates;
+    if (entry->key == key) {
+      return;
+    }
+    ecs_index_unlink(index, entity, entry);
+    entry->key = key;
+    ecs_index_link(index, entity, entry);
+    return;
+  }
+
+  // in the map first, so that a merge while linking sees the entry
+  ecs_index_entry_t added = {entity, key, 0, index->updates};
+  ecs_map_set(index->entries, (void *)entity, &added);
+  ecs_index_link(index, entity, ecs_map_get(index->entries, (void *)entity));
+}
+
+static void ecs_index_mark(ecs_index_t *index,
+                           const ecs_archetype_t *archetype) {
+  int32_t column = ecs_type_index_of(archetype->type, index->component);
+  if (column != -1) {
+    ecs_index_sync_t sync = {archetype->changed[column],
+                             archetype->rows_changed};
+    ecs_map_set(index->archetype_sync, (void *)archetype, &sync);
+  }
+}
+
+// drops entities that no longer exist or no longer have the component
+static void ecs_index_sweep(ecs_index_t *index) {
+  const ecs_registry_t *registry = index->registry;
+  ecs_index_entry_t *entries = ecs_map_values(index->entries);
+
+  // removing swaps the last entry in, so walk backwards
+  for (uint32_t i = ecs_map_len(index->entries); i-- > 0;) {
+    if (entries[i].seen == index->updates) {
+      continue;
+    }
+
+    const ecs_record_t *record =
+        ecs_map_get(registry->entity_index, (void *)entries[i].entity);
+    if (record == NULL ||
+        ecs_type_index_of(record->archetype->type, index->component) == -1) {
+      ecs_index_entry_t entry = entries[i];
+      ecs_index_unlink(index, entry.entity, &entry);
+      ecs_map_remove(index->entries, (void *)entry.entity);
+    }
+  }
+}
+
+static void ecs_index_rescan(ecs_index_t *index) {
+  const ecs_registry_t *registry = index->registry;
+  ecs_query_t *query = &index->query;
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  index->updates++;
+
+  bool rows_changed = false;
+  for (uint32_t i = 0; i < query->count; i++) {
+    ecs_archetype_t *archetype = query->archetypes[i];
+    uint32_t column = query->columns[i];
+    const ecs_index_sync_t *sync =
+        ecs_map_get(index->archetype_sync, (void *)archetype);
+    if (sync != NULL && sync->column == archetype->changed[column] &&
+        sync->rows == archetype->rows_changed) {
+      continue;
+    }
+
+    rows_changed =
+        rows_changed || sync == NULL || sync->rows != archetype->rows_changed;
+    for (uint32_t row = 0; row < archetype->count; row++) {
+      ecs_index_put(index, archetype->entity_ids[row], archetype, column, row);
+    }
+    ecs_index_mark(index, archetype);
+  }
+
+  if (rows_changed) {
+    ecs_index_sweep(index);
+  }
+  index->synced = registry->change_tick;
+}
+
+static inline void ecs_index_update(ecs_index_t *index) {
+  if (index->synced != index->registry->change_tick) {
+    ecs_index_rescan(index);
+  }
+}
+
+static void ecs_index_catch_up(ecs_index_t *index) {
+  ecs_index_update(index);
+  ecs_index_merge(index);
+}
+
+// lookups bring the index up to date first. read phases cannot, so the first
+// ecs_read_begin does it for them and lookups inside find nothing to do.
+static void ecs_index_ready(ecs_index_t *index) {
+  if (index->synced != index->registry->change_tick ||
+      index->pair_sorted != index->pair_count || index->pair_stale != 0) {
+    ecs_ensure_writable(index->registry);
+    ecs_index_catch_up(index);
+  }
+}
+
+static ecs_index_t *ecs_index_new(ecs_registry_t *registry,
+                                  ecs_entity_t component, size_t offset,
+                                  size_t size, ecs_key_t kind, bool sorted) {
+  const ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(size == 1 || size == 2 || size == 4 || size == 8,
+             "index keys are 1, 2, 4 or 8 bytes");
+  ECS_ENSURE(kind != ECS_KEY_FLOAT || size == 4 || size == 8,
+             "float keys are 4 or 8 bytes");
+  ECS_ENSURE(offset + size <= info->size, OUT_OF_BOUNDS);
+
+  ecs_index_t *index = ecs_malloc(sizeof(ecs_index_t));
+  index->field = -1;
+  index->field_start = 0;
+  for (uint32_t k = 0; k < info->field_count; k++) {
+    const ecs_field_t *field = &info->fields[k];
+    if (offset >= field->offset &&
+        offset + size <= field->offset + field->size) {
+      index->field = k;
+      break;
+    }
+    index->field_start += field->size;
+  }
+  ECS_ENSURE(info->field_count == 0 || index->field != -1,
+             "index key spans split fields");
+
+  index->registry = registry;
+  index->component = component;
+  index->offset = offset;
+  index->size = size;
+  index->kind = kind;
+  index->sorted = sorted;
+  index->current = false;
+  index->synced = 0;
+  index->updates = 0;
+  ecs_query_init(&index->query, ecs_signature_new_n(1, component));
+  index->archetype_sync =
+      ECS_MAP(intptr, ecs_archetype_t *, ecs_index_sync_t, 8);
+  index->entries = ECS_MAP(intptr, ecs_entity_t, ecs_index_entry_t, 64);
+  index->heads = sorted ? NULL : ECS_MAP(intptr, uintptr_t, ecs_entity_t, 64);
+  index->pair_count = 0;
+  index->pair_capacity = 0;
+  index->pair_sorted = 0;
+  index->pair_stale = 0;
+  index->pairs = NULL;
+
+  if (registry->index_count == registry->index_capacity) {
+    registry->index_capacity =
+        registry->index_capacity == 0 ? 4 : registry->index_capacity * 2;
+    ecs_realloc((void **)&registry->indices,
+                sizeof(ecs_index_t *) * registry->index_capacity);
+  }
+  registry->indices[registry->index_count++] = index;
+
+  ecs_index_rescan(index);
+  return index;
+}
+
+ecs_index_t *ecs_index_hash(ecs_registry_t *registry, ecs_entity_t component,
+                            size_t offset, size_t size, ecs_key_t kind) {
+  return ecs_index_new(registry, component, offset, size, kind, false);
+}
+
+ecs_index_t *ecs_index_sorted(ecs_registry_t *registry, ecs_entity_t component,
+                              size_t offset, size_t size, ecs_key_t kind) {
+  return ecs_index_new(registry, component, offset, size, kind, true);
+}
+
+void ecs_index_free(ecs_index_t *index) {
+  ecs_registry_t *registry = index->registry;
+  for (uint32_t i = 0; i < registry->index_count; i++) {
+    if (registry->indices[i] == index) {
+      registry->indices[i] = registry->indices[--registry->index_count];
+      break;
+    }
+  }
+
+  ecs_query_fini(&index->query);
+  ecs_map_free(index->archetype_sync);
+  ecs_map_free(index->entries);
+  if (index->heads != NULL) {
+    ecs_map_free(index->heads);
+  }
+  free(index->pairs);
+  free(index);
+}
+
+static void ecs_indices_begin(ecs_registry_t *registry) {
+  for (uint32_t i = 0; i < registry->index_count; i++) {
+    ecs_index_t *index = registry->indices[i];
+    index->current = index->synced == registry->change_tick;
+  }
+}
+
+// the entity moved without any value changing, except for a newly attached
+// component
+static void ecs_indices_attach(ecs_registry_t *registry,
+                               ecs_archetype_t *init_archetype,
+                               ecs_archetype_t *fini_archetype,
+                               ecs_entity_t entity, ecs_entity_t component,
+                               uint32_t row) {
+  for (uint32_t i = 0; i < registry->index_count; i++) {
+    ecs_index_t *index = registry->indices[i];
+    if (!index->current) {
+      continue;
+    }
+
+    ecs_index_mark(index, init_archetype);
+    ecs_index_mark(index, fini_archetype);
+    if (index->component == component) {
+      int32_t column = ecs_type_index_of(fini_archetype->type, component);
+      ecs_index_put(index, entity, fini_archetype, column, row);
+    }
+    index->synced = registry->change_tick;
+  }
+}
+
+static void ecs_indices_set(ecs_registry_t *registry,
+                            ecs_archetype_t *archetype, ecs_entity_t entity,
+                            ecs_entity_t component, uint32_t row) {
+  for (uint32_t i = 0; i < registry->index_count; i++) {
+    ecs_index_t *index = registry->indices[i];
+    if (!index->current) {
+      continue;
+    }
+
+    if (index->component == component) {
+      int32_t column = ecs_type_index_of(archetype->type, component);
+      ecs_index_put(index, entity, archetype, column, row);
+      ecs_index_mark(index, archetype);
+    }
+    index->synced = registry->change_tick;
+  }
+}
+
+// the first entity whose field equals value, or 0
+ecs_entity_t ecs_index_find(ecs_index_t *index, const void *value) {
+  ecs_entity_t entity = 0;
+  ecs_index_find_all(index, value, &entity, 1);
+  return entity;
+}
+
+// writes up to capacity entities whose field equals value and returns how many
+// there are. sorted indices return them in entity order.
+uint32_t ecs_index_find_all(ecs_index_t *index, const void *value,
+                            ecs_entity_t *out, uint32_t capacity) {
+  if (index->sorted) {
+    return ecs_index_range(index, value, value, out, capacity);
+  }
+
+  ecs_index_ready(index);
+  uint64_t key = ecs_index_key(index->kind, value, index->size);
+  ecs_entity_t *head = ecs_map_get(index->heads, (void *)(uintptr_t)key);
+  uint32_t count = 0;
+  for (ecs_entity_t entity = head != NULL ? *head : 0; entity != 0;) {
+    const ecs_index_entry_t *entry =
+        ecs_map_get(index->entries, (void *)entity);
+    if (entry->key == key) {
+      if (count < capacity) {
+        out[count] = entity;
+      }
+      count++;
+    }
+    entity = entry->next;
+  }
+  return count;
+}
+
+// like ecs_index_find_all for every value from min to max inclusive, in value
+// order. only for sorted indices.
+uint32_t ecs_index_range(ecs_index_t *index, const void *min, const void *max,
+                         ecs_entity_t *out, uint32_t capacity) {
+  ECS_ENSURE(index->sorted, "range lookups need a sorted index");
+  ecs_index_ready(index);
+
+  uint64_t lo = ecs_index_key(index->kind, min, index->size);
+  uint64_t hi = ecs_index_key(index->kind, max, index->size);
+  uint32_t count = 0;
+  for (uint32_t i = ecs_index_lower_bound(index, lo, 0);
+       i < index->pair_count && index->pairs[i].key <= hi; i++) {
+    if (count < capacity) {
+      out[count] = index->pairs[i].entity;
+    }
+    count++;
+  }
+  return count;
+}
+
+// sorting reorders an archetype's rows in place: a permutation is found first,
+// then applied to every column, including front buffers, and to the entity
+// index. ecs_sort takes a comparator, ecs_sort_by_key radix sorts on a field
+// with the same keys as secondary indices.
+
+#define SORT_RADIX_BITS 8
+#define SORT_RADIX_SIZE (1 << SORT_RADIX_BITS)
+
+// stable, so rows with equal values keep their order
+static void ecs_sort_order(uint32_t *order, uint32_t *scratch, uint32_t count,
+                           const unsigned char *values, size_t size,
+                           ecs_compare_fn compare) {
+  for (uint32_t width = 1; width < count; width *= 2) {
+    for (uint32_t lo = 0; lo < count; lo += 2 * width) {
+      uint32_t mid = lo + width < count ? lo + width : count;
+      uint32_t hi = mid + width < count ? mid + width : count;
+      uint32_t a = lo, b = mid, out = lo;
+      while (a < mid && b < hi) {
+        bool take_b = compare(values + size * order[b],
+                              values + size * order[a]) < 0;
+        scratch[out++] = take_b ? order[b++] : order[a++];
+      }
+      while (a < mid) {
+        scratch[out++] = order[a++];
+      }
+      while (b < hi) {
+        scratch[out++] = order[b++];
+      }
+    }
+    memcpy(order, scratch, sizeof(uint32_t) * count);
+  }
+}
+
+// least significant digit first, skipping digits every key shares
+static void ecs_sort_order_radix(uint32_t *order, uint32_t *scratch,
+                                 uint32_t count, const uint64_t *keys,
+                                 size_t key_size) {
+  for (uint32_t shift = 0; shift < key_size * 8; shift += SORT_RADIX_BITS) {
+    uint32_t histogram[SORT_RADIX_SIZE] = {0};
+    for (uint32_t i = 0; i < count; i++) {
+      histogram[(keys[i] >> shift) & (SORT_RADIX_SIZE - 1)]++;
+    }
+    if (histogram[(keys[0] >> shift) & (SORT_RADIX_SIZE - 1)] == count) {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t d = 0; d < SORT_RADIX_SIZE; d++) {
+      uint32_t n = histogram[d];
+      histogram[d] = offset;
+      offset += n;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t row = order[i];
+      scratch[histogram[(keys[row] >> shift) & (SORT_RADIX_SIZE - 1)]++] = row;
+    }
+    memcpy(order, scratch, sizeof(uint32_t) * count);
+  }
+}
+
+// gathers rows in order through scratch, one field at a time
+static void ecs_column_permute(const ecs_component_info_t *info, void *column,
+                               uint32_t capacity, const uint32_t *order,
+                               uint32_t count, void *scratch) {
+  ecs_field_t whole = {0, info->size};
+  const ecs_field_t *fields = info->field_count == 0 ? &whole : info->fields;
+  uint32_t field_count = info->field_count == 0 ? 1 : info->field_count;
+
+  size_t start = 0;
+  for (uint32_t k = 0; k < field_count; k++) {
+    size_t size = fields[k].size;
+    unsigned char *array = ECS_OFFSET(column, capacity * start);
+    for (uint32_t i = 0; i < count; i++) {
+      memcpy(ECS_OFFSET(scratch, size * i), array + size * order[i], size);
+    }
+    memcpy(array, scratch, size * count);
+    start += size;
+  }
+}
+
+static void ecs_archetype_permute(ecs_registry_t *registry,
+                                  ecs_archetype_t *archetype,
+                                  const uint32_t *order) {
+  uint32_t count = archetype->count;
+  size_t widest = sizeof(ecs_entity_t);
+  uint32_t type_len = ecs_type_len(archetype->type);
+  for (uint32_t i = 0; i < type_len; i++) {
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)archetype->type->elements[i]);
+    widest = info->size > widest ? info->size : widest;
+  }
+  void *scratch = ecs_malloc(widest * count);
+
+  for (uint32_t i = 0; i < type_len; i++) {
+    const ecs_component_info_t *info = ecs_map_get(
+        registry->component_index, (void *)archetype->type->elements[i]);
+    ecs_column_permute(info, archetype->components[i], archetype->capacity,
+                       order, count, scratch);
+    if (archetype->front[i] != NULL) {
+      ecs_column_permute(info, archetype->front[i], archetype->capacity, order,
+                         count, scratch);
+    }
+  }
+
+  ecs_entity_t *ids = scratch;
+  for (uint32_t i = 0; i < count; i++) {
+    ids[i] = archetype->entity_ids[order[i]];
+  }
+  memcpy(archetype->entity_ids, ids, sizeof(ecs_entity_t) * count);
+  free(scratch);
+
+  for (uint32_t row = 0; row < count; row++) {
+    ecs_record_t *record =
+        ecs_map_get(registry->entity_index, (void *)archetype->entity_ids[row]);
+    record->row = row;
+  }
+  ecs_archetype_touch(registry, archetype);
+}
+
+static void ecs_ensure_sortable(const ecs_registry_t *registry) {
+  ecs_ensure_structural(registry);
+  ECS_ENSURE(!registry->deterministic,
+             "deterministic registries keep rows in entity order");
+}
+
+// sorts the rows of every archetype with the component by its value
+void ecs_sort(ecs_registry_t *registry, ecs_entity_t component,
+              ecs_compare_fn compare) {
+  ecs_ensure_sortable(registry);
+  const ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    int32_t column = ecs_type_index_of((*archetype)->type, component);
+    uint32_t count = (*archetype)->count;
+    if (column == -1 || count < 2) {
+      continue;
+    }
+
+    ecs_archetype_inflate(*archetype);
+    unsigned char *values = ecs_malloc(info->size * count);
+    uint32_t *order = ecs_malloc(sizeof(uint32_t) * count * 2);
+    for (uint32_t row = 0; row < count; row++) {
+      ecs_column_read(info, (*archetype)->components[column],
+                      (*archetype)->capacity, row, values + info->size * row);
+      order[row] = row;
+    }
+
+    ecs_sort_order(order, order + count, count, values, info->size, compare);
+    ecs_archetype_permute(registry, *archetype, order);
+    free(order);
+    free(values);
+  });
+  registry->epoch++;
+}
+
+// like ecs_sort, ordering by a field as keyed by secondary indices
+void ecs_sort_by_key(ecs_registry_t *registry, ecs_entity_t component,
+                     size_t offset, size_t size, ecs_key_t kind) {
+  ecs_ensure_sortable(registry);
+  const ecs_component_info_t *info =
+      ecs_map_get(registry->component_index, (void *)component);
+  ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+  ECS_ENSURE(size == 1 || size == 2 || size == 4 || size == 8,
+             "sort keys are 1, 2, 4 or 8 bytes");
+  ECS_ENSURE(offset + size <= info->size, OUT_OF_BOUNDS);
+
+  unsigned char *value = alloca(info->size);
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    int32_t column = ecs_type_index_of((*archetype)->type, component);
+    uint32_t count = (*archetype)->count;
+    if (column == -1 || count < 2) {
+      continue;
+    }
+
+    ecs_archetype_inflate(*archetype);
+    uint64_t *keys = ecs_malloc(sizeof(uint64_t) * count);
+    uint32_t *order = ecs_malloc(sizeof(uint32_t) * count * 2);
+    for (uint32_t row = 0; row < count; row++) {
+      ecs_column_read(info, (*archetype)->components[column],
+                      (*archetype)->capacity, row, value);
+      keys[row] = ecs_index_key(kind, value + offset, size);
+      order[row] = row;
+    }
+
+    ecs_sort_order_radix(order, order + count, count, keys, size);
+    ecs_archetype_permute(registry, *archetype, order);
+    free(order);
+    free(keys);
+  });
+  registry->epoch++;
+}
+
+// like ecs_query_each, but rows come out in order of the signature's column,
+// merged across archetypes that are each sorted by compare, as ecs_sort leaves
+// them. fn sees runs of consecutive rows from one archetype.
+void ecs_query_each_sorted(const ecs_registry_t *registry, ecs_query_t *query,
+                           uint32_t column, ecs_compare_fn compare,
+                           ecs_each_fn fn, void *ctx) {
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  uint32_t sig_count = query->sig->count;
+  ECS_ENSURE(column < sig_count, OUT_OF_BOUNDS);
+  for (uint32_t i = 0; i < sig_count; i++) {
+    ECS_ENSURE(query->component_fields[i] == NULL,
+               "sorted queries cannot use split components");
+  }
+  ecs_query_touch(registry, query);
+
+  uint32_t count = query->count;
+  uint32_t next[count > 0 ? count : 1]; // the first row not yet visited
+  for (uint32_t i = 0; i < count; i++) {
+    next[i] = 0;
+    ecs_column_inflate(query->archetypes[i],
+                       query->columns[i * sig_count + column]);
+  }
+
+  size_t size = query->component_sizes[column];
+  for (;;) {
+    // the archetype with the smallest next value, and the runner up
+    int32_t best = -1, second = -1;
+    const void *best_value = NULL, *second_value = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+      const ecs_archetype_t *archetype = query->archetypes[i];
+      if (next[i] == archetype->count) {
+        continue;
+      }
+
+      const void *value = ECS_OFFSET(
+          archetype->components[query->columns[i * sig_count + column]],
+          size * next[i]);
+      if (best == -1 || compare(value, best_value) < 0) {
+        second = best;
+        second_value = best_value;
+        best = i;
+        best_value = value;
+      } else if (second == -1 || compare(value, second_value) < 0) {
+        second = i;
+        second_value = value;
+      }
+    }
+    if (best == -1) {
+      return;
+    }
+
+    // the best archetype runs until it passes the runner up. ties go to the
+    // archetype that comes first in the query.
+    const ecs_archetype_t *archetype = query->archetypes[best];
+    const void *base =
+        archetype->components[query->columns[best * sig_count + column]];
+    uint32_t start = next[best];
+    uint32_t end = second == -1 ? archetype->count : start + 1;
+    while (end < archetype->count) {
+      int order = compare(ECS_OFFSET(base, size * end), second_value);
+      if (order > 0 || (order == 0 && second < best)) {
+        break;
+      }
+      end++;
+    }
+    next[best] = end;
+
+    uint32_t type_len = ecs_type_len(archetype->type);
+    void *component_arrays[type_len];
+    ecs_view_t view = ecs_query_view(query, best);
+    for (uint32_t i = 0; i < sig_count; i++) {
+      uint32_t at = view.signature_to_index[i];
+      size_t skipped = (size_t)view.component_sizes[i] * start;
+      component_arrays[at] = ECS_OFFSET(view.component_arrays[at], skipped);
+    }
+    view.component_arrays = component_arrays;
+    fn(view, end - start, ctx);
+  }
+}
+
+// an owning group keeps the columns of its components, for every archetype
+// that has all of them, in one shared slab per component. each archetype has
+// a segment of its capacity in rows there. segments start on a cache line in
+// every slab, like any other column, so parallel ranges stay clean. segments
+// that outgrow their place move to the end of the slab, and ecs_group_compact
+// closes the holes left behind, after which ecs_group_each sees segments
+// whose row counts fill whole cache lines as one run.
+//
+// an archetype that matches several groups belongs to the first one that
+// finds it. the others keep it as a guest and visit its columns where they
+// are, one archetype at a time.
+
+typedef struct ecs_group_member_t {
+  ecs_archetype_t *archetype;
+  uint32_t match; // index in the group's query
+  uint32_t start; // first slab row of the archetype's segment
+} ecs_group_member_t;
+
+struct ecs_group_t {
+  ecs_registry_t *registry;
+  ecs_query_t query;
+  uint32_t *sizes;
+  uint32_t align; // rows that fill whole cache lines in every slab
+  uint32_t member_count;
+  uint32_t member_capacity;
+  ecs_group_member_t *members; // in slab order
+  uint32_t guest_count;
+  uint32_t guest_capacity;
+  uint32_t *guests;  // query indices of archetypes owned by another group
+  uint32_t used;     // rows up to the end of the last segment
+  uint32_t capacity; // rows in each slab
+  void **slabs;      // one per signature component
+};
+
+static bool ecs_group_owns(const ecs_group_t *group, ecs_entity_t component) {
+  return ecs_type_index_of(group->query.type, component) != -1;
+}
+
+// the first segment start at or after row
+static uint32_t ecs_group_align(const ecs_group_t *group, uint32_t row) {
+  return (row + group->align - 1) / group->align * group->align;
+}
+
+// aims the archetype's owned columns at its segment
+static void ecs_group_point(ecs_group_t *group,
+                            const ecs_group_member_t *member) {
+  uint32_t sig_count = group->query.sig->count;
+  const uint32_t *columns = &group->query.columns[member->match * sig_count];
+  for (uint32_t j = 0; j < sig_count; j++) {
+    member->archetype->components[columns[j]] = ECS_OFFSET(
+        group->slabs[j], (size_t)group->sizes[j] * member->start);
+  }
+}
+
+// copies every segment into new slabs of at least capacity rows, back to back
+// with non-empty archetypes first. grown, if not NULL, goes last with room for
+// grown_capacity rows.
+static void ecs_group_repack(ecs_group_t *group, const ecs_archetype_t *grown,
+                             uint32_t grown_capacity, uint32_t capacity) {
+  uint32_t sig_count = group->query.sig->count;
+  ecs_group_member_t *members =
+      ecs_malloc(sizeof(ecs_group_member_t) * group->member_capacity);
+  uint32_t count = 0;
+  for (uint32_t pass = 0; pass < 3; pass++) {
+    for (uint32_t i = 0; i < group->member_count; i++) {
+      const ecs_archetype_t *archetype = group->members[i].archetype;
+      uint32_t rank = archetype == grown ? 2 : archetype->count == 0 ? 1 : 0;
+      if (rank == pass) {
+        members[count++] = group->members[i];
+      }
+    }
+  }
+
+  uint32_t starts[count + 1];
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const ecs_archetype_t *archetype = members[i].archetype;
+    starts[i] = start = ecs_group_align(group, start);
+    start += archetype == grown ? grown_capacity : archetype->capacity;
+  }
+  capacity = start > capacity ? start : capacity;
+
+  void *slabs[sig_count];
+  for (uint32_t j = 0; j < sig_count; j++) {
+    slabs[j] = NULL;
+    ecs_realloc_aligned(&slabs[j], 0, (size_t)group->sizes[j] * capacity);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    const ecs_archetype_t *archetype = members[i].archetype;
+    if (archetype->count > 0) {
+      for (uint32_t j = 0; j < sig_count; j++) {
+        size_t size = group->sizes[j];
+        memcpy(ECS_OFFSET(slabs[j], size * starts[i]),
+               ECS_OFFSET(group->slabs[j], size * members[i].start),
+               size * archetype->count);
+      }
+    }
+    members[i].start = starts[i];
+  }
+
+  for (uint32_t j = 0; j < sig_count; j++) {
+    free(group->slabs[j]);
+    group->slabs[j] = slabs[j];
+  }
+  free(group->members);
+  group->members = members;
+  group->used = start;
+  group->capacity = capacity;
+  for (uint32_t i = 0; i < count; i++) {
+    ecs_group_point(group, &group->members[i]);
+  }
+}
+
+// rows held by every segment but the one of skip
+static uint32_t ecs_group_live(const ecs_group_t *group,
+                               const ecs_archetype_t *skip) {
+  uint32_t live = 0;
+  for (uint32_t i = 0; i < group->member_count; i++) {
+    if (group->members[i].archetype != skip) {
+      live += group->members[i].archetype->capacity;
+    }
+  }
+  return live;
+}
+
+// called as the archetype changes capacity, before archetype->capacity is set
+static void ecs_group_resize(ecs_group_t *group, ecs_archetype_t *archetype,
+                             uint32_t capacity) {
+  uint32_t index = 0;
+  while (group->members[index].archetype != archetype) {
+    index++;
+    ECS_ASSERT(index < group->member_count, FAILED_LOOKUP);
+  }
+
+  ecs_group_member_t *member = &group->members[index];
+  bool last = member->start + archetype->capacity == group->used;
+  if (last && member->start + capacity <= group->capacity) {
+    group->used = member->start + capacity;
+    return;
+  }
+  if (capacity <= archetype->capacity) {
+    return; // the rest of the segment is a hole until compacted
+  }
+
+  uint32_t start = ecs_group_align(group, group->used);
+  if (start + capacity > group->capacity) {
+    uint32_t live = ecs_group_live(group, archetype) + capacity;
+    ecs_group_repack(group, archetype, capacity, live * 2);
+    return;
+  }
+
+  uint32_t sig_count = group->query.sig->count;
+  for (uint32_t j = 0; j < sig_count; j++) {
+    size_t size = group->sizes[j];
+    memcpy(ECS_OFFSET(group->slabs[j], size * start),
+           ECS_OFFSET(group->slabs[j], size * member->start),
+           size * archetype->count);
+  }
+
+  ecs_group_member_t moved = *member;
+  moved.start = start;
+  memmove(member, member + 1,
+          sizeof(ecs_group_member_t) * (group->member_count - index - 1));
+  group->members[group->member_count - 1] = moved;
+  group->used = start + capacity;
+  ecs_group_point(group, &moved);
+}
+
+// takes the columns of archetypes created since the last update
+static void ecs_group_update(ecs_group_t *group) {
+  ecs_registry_t *registry = group->registry;
+  ecs_query_t *query = &group->query;
+  uint32_t matched = query->count;
+  ecs_query_update(query, registry->type_index, registry->component_index);
+  if (matched == query->count) {
+    return;
+  }
+  ecs_ensure_writable(registry);
+
+  uint32_t sig_count = query->sig->count;
+  for (uint32_t i = matched; i < query->count; i++) {
+    ecs_archetype_t *archetype = query->archetypes[i];
+    if (archetype->group != NULL) {
+      if (group->guest_count == group->guest_capacity) {
+        group->guest_capacity =
+            group->guest_capacity == 0 ? 4 : group->guest_capacity * 2;
+        ecs_realloc((void **)&group->guests,
+                    sizeof(uint32_t) * group->guest_capacity);
+      }
+      group->guests[group->guest_count++] = i;
+      continue;
+    }
+    ecs_archetype_inflate(archetype);
+
+    if (group->member_count == group->member_capacity) {
+      group->member_capacity =
+          group->member_capacity == 0 ? 4 : group->member_capacity * 2;
+      ecs_realloc((void **)&group->members,
+                  sizeof(ecs_group_member_t) * group->member_capacity);
+    }
+
+    if (ecs_group_align(group, group->used) + archetype->capacity >
+        group->capacity) {
+      uint32_t live = ecs_group_live(group, NULL) + archetype->capacity;
+      ecs_group_repack(group, NULL, 0, live * 2);
+    }
+
+    ecs_group_member_t *member = &group->members[group->member_count++];
+    *member = (ecs_group_member_t){archetype, i,
+                                   ecs_group_align(group, group->used)};
+    const uint32_t *columns = &query->columns[i * sig_count];
+    for (uint32_t j = 0; j < sig_count; j++) {
+      size_t size = group->sizes[j];
+      void *column = archetype->components[columns[j]];
+      if (archetype->count > 0) {
+        memcpy(ECS_OFFSET(group->slabs[j], size * member->start), column,
+               size * archetype->count);
+      }
+      free(column);
+    }
+    group->used = member->start + archetype->capacity;
+    archetype->group = group;
+    ecs_group_point(group, member);
+  }
+}
+
+ecs_group_t *ecs_group(ecs_registry_t *registry, ecs_signature_t *sig) {
+  ecs_ensure_writable(registry);
+  ECS_ENSURE(sig->count > 0, "groups own at least one component");
+
+  for (uint32_t i = 0; i < registry->group_count; i++) {
+    for (uint32_t j = 0; j < sig->count; j++) {
+      ECS_ENSURE(!ecs_group_owns(registry->groups[i], sig->components[j]),
+                 "component is owned by another group");
+    }
+  }
+
+  ecs_group_t *group = ecs_malloc(sizeof(ecs_group_t));
+  group->registry = registry;
+  ecs_query_init(&group->query, sig);
+  group->sizes = ecs_malloc(sizeof(uint32_t) * sig->count);
+  group->slabs = ecs_malloc(sizeof(void *) * sig->count);
+  group->align = 1;
+  for (uint32_t j = 0; j < sig->count; j++) {
+    const ecs_component_info_t *info =
+        ecs_map_get(registry->component_index, (void *)sig->components[j]);
+    ECS_ENSURE(info != NULL, FAILED_LOOKUP);
+    ECS_ENSURE(info->field_count == 0, "groups cannot own split components");
+    group->sizes[j] = info->size;
+    group->slabs[j] = NULL;
+    uint32_t rows = CACHE_LINE / ecs_gcd(CACHE_LINE, info->size);
+    group->align = rows > group->align ? rows : group->align;
+  }
+  group->member_count = 0;
+  group->member_capacity = 0;
+  group->members = NULL;
+  group->guest_count = 0;
+  group->guest_capacity = 0;
+  group->guests = NULL;
+  group->used = 0;
+  group->capacity = 0;
+
+  if (registry->group_count == registry->group_capacity) {
+    registry->group_capacity =
+        registry->group_capacity == 0 ? 4 : registry->group_capacity * 2;
+    ecs_realloc((void **)&registry->groups,
+                sizeof(ecs_group_t *) * registry->group_capacity);
+  }
+  registry->groups[registry->group_count++] = group;
+
+  ecs_group_update(group);
+  return group;
+}
+
+// gives every archetype its own columns back
+void ecs_group_free(ecs_group_t *group) {
+  ecs_registry_t *registry = group->registry;
+  ecs_ensure_writable(registry);
+  for (uint32_t i = 0; i < registry->group_count; i++) {
+    if (registry->groups[i] == group) {
+      registry->groups[i] = registry->groups[--registry->group_count];
+      break;
+    }
+  }
+
+  uint32_t sig_count = group->query.sig->count;
+  for (uint32_t i = 0; i < group->member_count; i++) {
+    const ecs_group_member_t *member = &group->members[i];
+    ecs_archetype_t *archetype = member->archetype;
+    const uint32_t *columns = &group->query.columns[member->match * sig_count];
+    for (uint32_t j = 0; j < sig_count; j++) {
+      size_t size = group->sizes[j];
+      void *column = NULL;
+      ecs_realloc_aligned(&column, 0, size * archetype->capacity);
+      if (archetype->count > 0) {
+        memcpy(column, archetype->components[columns[j]],
+               size * archetype->count);
+      }
+      archetype->components[columns[j]] = column;
+    }
+    archetype->group = NULL;
+  }
+
+  for (uint32_t j = 0; j < sig_count; j++) {
+    free(group->slabs[j]);
+  }
+  free(group->slabs);
+  free(group->sizes);
+  free(group->members);
+  free(group->guests);
+  ecs_query_fini(&group->query);
+  free(group);
+}
+
+// trims every archetype in the group to its row count, then lays the segments
+// out back to back so that the group's rows are in one run
+void ecs_group_compact(ecs_group_t *group) {
+  ecs_registry_t *registry = group->registry;
+  ecs_ensure_writable(registry);
+  ecs_group_update(group);
+
+  for (uint32_t i = 0; i < group->member_count; i++) {
+    ecs_archetype_t *archetype = group->members[i].archetype;
+    uint32_t capacity = archetype->count > 0 ? archetype->count : 1;
+    if (capacity < archetype->capacity) {
+      ecs_realloc((void **)&archetype->entity_ids,
+                  sizeof(ecs_entity_t) * capacity);
+      ecs_archetype_resize_component_array(
+          archetype, registry->component_index, archetype->capacity, capacity);
+    }
+  }
+  ecs_group_repack(group, NULL, 0, ecs_group_live(group, NULL));
+}
+
+// like ecs_query_each over the group's signature, but fn is called once for
+// each run of rows that are adjacent in the slabs rather than per archetype,
+// then once for each guest
+void ecs_group_each(ecs_group_t *group, ecs_each_fn fn, void *ctx) {
+  ecs_group_update(group);
+
+  uint32_t sig_count = group->query.sig->count;
+  uint32_t identity[sig_count];
+  void *arrays[sig_count];
+  for (uint32_t j = 0; j < sig_count; j++) {
+    identity[j] = j;
+  }
+
+  for (uint32_t i = 0; i < group->member_count;) {
+    uint32_t start = group->members[i].start, rows = 0;
+    for (; i < group->member_count && group->members[i].start == start + rows;
+         i++) {
+      rows += group->members[i].archetype->count;
+    }
+    if (rows == 0) {
+      continue;
+    }
+
+    for (uint32_t j = 0; j < sig_count; j++) {
+      arrays[j] = ECS_OFFSET(group->slabs[j], (size_t)group->sizes[j] * start);
+    }
+    fn((ecs_view_t){arrays, identity, group->sizes,
+                    group->query.component_fields, rows, 0.0f},
+       rows, ctx);
+  }
+
+  for (uint32_t i = 0; i < group->guest_count; i++) {
+    uint32_t count = group->query.archetypes[group->guests[i]]->count;
+    if (count != 0) {
+      fn(ecs_query_view(&group->query, group->guests[i]), count, ctx);
+    }
+  }
+}
+
+// cold columns are found from the rows systems ran over since the last call,
+// kept in ecs_archetype_t::accesses. a cold column is packed as runs of equal
+// rows and its array freed. columns of empty archetypes pack to nothing.
+
+// writes the runs to out unless it is NULL, and returns their size
+static size_t ecs_column_pack(unsigned char *out, const void *array,
+                              uint32_t count, uint32_t size) {
+  size_t packed_size = 0;
+  for (uint32_t row = 0; row < count;) {
+    const void *value = ECS_OFFSET(array, (size_t)size * row);
+    uint32_t run = 1;
+    while (row + run < count &&
+           memcmp(ECS_OFFSET(array, (size_t)size * (row + run)), value,
+                  size) == 0) {
+      run++;
+    }
+    if (out != NULL) {
+      memcpy(out + packed_size, &run, sizeof(run));
+      memcpy(out + packed_size + sizeof(run), value, size);
+    }
+    packed_size += sizeof(run) + size;
+    row += run;
+  }
+  return packed_size;
+}
+
+// the total of the rows of every archetype with the component that systems
+// have run over since the last ecs_compress_cold
+uint64_t ecs_accesses(const ecs_registry_t *registry, ecs_entity_t component) {
+  uint64_t accesses = 0;
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    int32_t column = ecs_type_index_of((*archetype)->type, component);
+    if (column != -1) {
+      accesses += (*archetype)->accesses[column];
+    }
+  });
+  return accesses;
+}
+
+// packs every column that systems ran over at most max_accesses rows of since
+// the last call, when packing saves memory, and starts counting again. split,
+// double buffered and group owned columns stay in place.
+uint32_t ecs_compress_cold(ecs_registry_t *registry, uint64_t max_accesses) {
+  ecs_ensure_writable(registry);
+  uint32_t compressed = 0;
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, it, {
+    ecs_archetype_t *archetype = *it;
+    uint32_t type_len = ecs_type_len(archetype->type);
+    for (uint32_t i = 0; i < type_len; i++) {
+      ecs_entity_t component = archetype->type->elements[i];
+      const ecs_component_info_t *info =
+          ecs_map_get(registry->component_index, (void *)component);
+      bool cold = archetype->accesses[i] <= max_accesses &&
+                  info->field_count == 0 && !info->buffered &&
+                  (archetype->group == NULL ||
+                   !ecs_group_owns(archetype->group, component)) &&
+                  (archetype->cold == NULL || !archetype->cold[i].compressed);
+      archetype->accesses[i] = 0;
+      if (!cold) {
+        continue;
+      }
+
+      size_t packed_size = ecs_column_pack(NULL, archetype->components[i],
+                                           archetype->count, info->size);
+      if (packed_size >= info->size * archetype->capacity) {
+        continue;
+      }
+
+      if (archetype->cold == NULL) {
+        archetype->cold = ecs_calloc(sizeof(ecs_cold_t), type_len);
+      }
+      ecs_cold_t *packed = &archetype->cold[i];
+      *packed = (ecs_cold_t){true, info->size, packed_size, NULL};
+      if (packed_size > 0) {
+        packed->packed = ecs_malloc(packed_size);
+        ecs_column_pack(packed->packed, archetype->components[i],
+                        archetype->count, info->size);
+      }
+      free(archetype->components[i]);
+      archetype->components[i] = NULL;
+      archetype->cold_count++;
+      compressed++;
+    }
+  });
+  return compressed;
+}
+
+// unpacks every compressed column, as before a read phase
+void ecs_inflate(ecs_registry_t *registry) {
+  ecs_ensure_writable(registry);
+  ecs_registry_inflate(registry);
+}
+
+// bytes held by compressed columns
+size_t ecs_cold_bytes(const ecs_registry_t *registry) {
+  size_t bytes = 0;
+  ECS_MAP_VALUES_EACH(registry->type_index, ecs_archetype_t *, archetype, {
+    uint32_t type_len = ecs_type_len((*archetype)->type);
+    for (uint32_t i = 0; i < type_len && (*archetype)->cold != NULL; i++) {
+      bytes += (*archetype)->cold[i].packed_size;
+    }
+  });
+  return bytes;
+}
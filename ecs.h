@@ -2,6 +2,7 @@
 #define ECS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -30,8 +31,8 @@ extern "C"
   void *ecs_map_get(const ecs_map_t *map, const void *key);
   void ecs_map_set(ecs_map_t *map, const void *key, const void *payload);
   void ecs_map_remove(ecs_map_t *map, const void *key);
-  void *ecs_map_values(ecs_map_t *map);
-  uint32_t ecs_map_len(ecs_map_t *map);
+  void *ecs_map_values(const ecs_map_t *map);
+  uint32_t ecs_map_len(const ecs_map_t *map);
   uint32_t ecs_map_hash_intptr(const void *key);
   uint32_t ecs_map_hash_string(const void *key);
   uint32_t ecs_map_hash_type(const void *key);
@@ -85,10 +86,15 @@ extern "C"
 #endif
 
   // -- SIGNATURE --------------------------------------------------------------
-  // component ids in a defined order
+  // component ids in a defined order. systems and query walks mark the columns
+  // they visit as changed, except for components wrapped in ECS_READ, which
+  // they promise only to read. only the first 64 components can be read only.
 
   typedef struct ecs_signature_t ecs_signature_t;
 
+#define ECS_READ_ONLY (~(UINTPTR_MAX >> 1))
+#define ECS_READ(component) ((ecs_entity_t)(component) | ECS_READ_ONLY)
+
   ecs_signature_t *ecs_signature_new(uint32_t count);
   ecs_signature_t *ecs_signature_new_n(uint32_t count, ...);
   void ecs_signature_free(ecs_signature_t *sig);
@@ -152,32 +158,402 @@ extern "C"
   // -- ENTITY COMPONENT SYSTEM ------------------------------------------------
   // functions below is the intended public api
 
+  // describes one member of a component struct. components split into fields
+  // store every field as its own array instead of storing whole structs.
+  typedef struct ecs_field_t {
+    size_t offset;
+    size_t size;
+  } ecs_field_t;
+
   typedef struct ecs_view_t {
     void **component_arrays;
     uint32_t *signature_to_index;
     uint32_t *component_sizes;
+    const ecs_field_t **component_fields; // NULL unless split
+    uint32_t capacity;
+    float delta_time; // seconds covered by this run of the system
   } ecs_view_t;
 
+  // called with each row of every matching archetype, or once per archetype
+  // with its row count for systems registered with ecs_system_chunk
   typedef void (*ecs_system_fn)(ecs_view_t, uint32_t);
 
+  // called once per non-empty archetype matched by a query
+  typedef void (*ecs_each_fn)(ecs_view_t view, uint32_t count, void *ctx);
+
+  // systems run phase by phase, in this order
+  typedef enum ecs_phase_t {
+    ECS_PRE_UPDATE,
+    ECS_UPDATE,
+    ECS_POST_UPDATE,
+    ECS_RENDER_PREP,
+    ECS_PHASE_COUNT,
+  } ecs_phase_t;
+
+  // runs job(data, i) for every i below count, on any number of threads, and
+  // returns once all of them have finished
+  typedef void (*ecs_job_fn)(void *data, uint32_t index);
+  typedef void (*ecs_parallel_fn)(ecs_job_fn job, void *data, uint32_t count,
+                                  void *ctx);
+
   typedef struct ecs_registry_t ecs_registry_t;
+  typedef struct ecs_spawner_t ecs_spawner_t;
+  typedef struct ecs_query_t ecs_query_t;
 
   ecs_registry_t *ecs_init(void);
+  // a lightweight world with its own entities and systems that shares the
+  // component definitions and id space of an existing one. worlds can step on
+  // different threads once every component has been defined.
+  ecs_registry_t *ecs_init_shared(ecs_registry_t *registry);
   void ecs_destroy(ecs_registry_t *registry);
   ecs_entity_t ecs_entity(ecs_registry_t *registry);
+
+  // one spawner per thread. ecs_spawn only touches its own spawner, so
+  // parallel systems can create entities. they are added to the registry by
+  // ecs_sync, which ecs_step calls after the last system.
+  ecs_spawner_t *ecs_spawner(ecs_registry_t *registry);
+  ecs_entity_t ecs_spawn(ecs_spawner_t *spawner);
+  void ecs_sync(ecs_registry_t *registry);
+
   ecs_entity_t ecs_component(ecs_registry_t *registry, size_t component_size);
+  void ecs_component_split(ecs_registry_t *registry, ecs_entity_t component,
+                           uint32_t field_count, const ecs_field_t *fields);
+  // systems write the back buffer of a double buffered component while other
+  // threads read last step's values from the front with ecs_get_front and
+  // ecs_query_each_front, between ecs_front_begin and ecs_front_end. those
+  // wait for the next step to start running systems, and the step waits for
+  // them to end before the front catches up. front_begin returns the number
+  // of publishes so far, so readers can tell when the front changed. systems
+  // cannot make structural changes, which would move the fronts under the
+  // readers; they spawn through an ecs_spawner instead.
+  void ecs_component_buffered(ecs_registry_t *registry, ecs_entity_t component);
+  uint64_t ecs_front_begin(ecs_registry_t *registry);
+  void ecs_front_end(ecs_registry_t *registry);
   ecs_entity_t ecs_system(ecs_registry_t *registry, ecs_signature_t *signature,
                           ecs_system_fn system);
+  ecs_entity_t ecs_system_chunk(ecs_registry_t *registry,
+                                ecs_signature_t *signature,
+                                ecs_system_fn system);
+  ecs_query_t *ecs_query(ecs_registry_t *registry, ecs_signature_t *signature);
+  void ecs_query_free(ecs_query_t *query);
+  void ecs_query_each(const ecs_registry_t *registry, ecs_query_t *query,
+                      ecs_each_fn fn, void *ctx);
+  void ecs_query_each_front(const ecs_registry_t *registry, ecs_query_t *query,
+                            ecs_each_fn fn, void *ctx);
+  void ecs_system_interval(ecs_registry_t *registry, ecs_entity_t system,
+                           float interval, float phase);
+  void ecs_system_fixed(ecs_registry_t *registry, ecs_entity_t system,
+                        float interval, float phase);
+  void ecs_system_enable(ecs_registry_t *registry, ecs_entity_t system);
+  void ecs_system_disable(ecs_registry_t *registry, ecs_entity_t system);
+  void ecs_system_remove(ecs_registry_t *registry, ecs_entity_t system);
+  void ecs_system_budget(ecs_registry_t *registry, ecs_entity_t system,
+                         uint32_t max_rows, uint32_t max_usec);
+  void ecs_system_stride(ecs_registry_t *registry, ecs_entity_t system,
+                         uint32_t stride);
+  void ecs_executor(ecs_registry_t *registry, ecs_parallel_fn parallel,
+                    void *ctx, uint32_t workers);
+  void ecs_system_parallel(ecs_registry_t *registry, ecs_entity_t system,
+                           uint32_t grain);
+  void ecs_system_phase(ecs_registry_t *registry, ecs_entity_t system,
+                        ecs_phase_t phase);
+  void ecs_system_after(ecs_registry_t *registry, ecs_entity_t system,
+                        ecs_entity_t other);
+  void ecs_system_before(ecs_registry_t *registry, ecs_entity_t system,
+                         ecs_entity_t other);
   void ecs_attach(ecs_registry_t *registry, ecs_entity_t entity,
                   ecs_entity_t component);
   void ecs_set(ecs_registry_t *registry, ecs_entity_t entity,
                ecs_entity_t component, const void *data);
+
+  // moves entities, with all of their components, to a world that shares
+  // component definitions with src. entities keep their ids.
+  void ecs_migrate(ecs_registry_t *dst, ecs_registry_t *src,
+                   const ecs_entity_t *entities, uint32_t count);
+  void ecs_migrate_matching(ecs_registry_t *dst, ecs_registry_t *src,
+                            ecs_signature_t *signature);
+
+  // lockstep. a deterministic registry keeps rows sorted by entity id and
+  // visits archetypes in type order, so registries that are given the same
+  // ids and inputs step identically. must be enabled before anything else.
+  void ecs_deterministic(ecs_registry_t *registry);
+  uint64_t ecs_world_hash(const ecs_registry_t *registry);
+
+  // change tracking and checksums. every write by a system, ecs_set or a
+  // structural change stamps the columns involved with a new change tick.
+  // query walks mark the columns of their signature, as their views may be
+  // written, unless wrapped in ECS_READ. writes through ecs_get pointers are
+  // reported with ecs_changed.
+  // ecs_checksum hashes the given components (all when count is zero) and
+  // only rehashes columns that changed since the last call.
+  void ecs_changed(ecs_registry_t *registry, ecs_entity_t component);
+  uint64_t ecs_change_tick(const ecs_registry_t *registry);
+  uint64_t ecs_checksum(ecs_registry_t *registry,
+                        const ecs_entity_t *components, uint32_t count);
+
+  // read phases. between ecs_read_begin and ecs_read_end any number of threads
+  // may call ecs_get and ecs_query_each (each with its own query, and marking
+  // nothing changed), and the registry refuses changes. the epoch changes
+  // whenever entities are added or moved between archetypes, so readers can
+  // tell when cached pointers die.
+  // ecs_get unpacks the column it reads if it is compressed, which is why a
+  // read phase can only begin once ecs_inflate has unpacked them all.
+  // the first ecs_read_begin also brings secondary indices up to date, while
+  // any others wait, so lookups work inside; spatial queries, checksums and
+  // system settings do not.
+  uint64_t ecs_read_begin(ecs_registry_t *registry);
+  void ecs_read_end(ecs_registry_t *registry);
+  uint64_t ecs_epoch(const ecs_registry_t *registry);
+  const void *ecs_get(const ecs_registry_t *registry, ecs_entity_t entity,
+                      ecs_entity_t component);
+  const void *ecs_get_front(const ecs_registry_t *registry,
+                            ecs_entity_t entity, ecs_entity_t component);
+  // split components have no struct to point at, so ecs_get refuses them.
+  // ecs_get_split gathers their fields into out instead, and copies any other
+  // component whole. returns false if the entity does not have the component.
+  bool ecs_get_split(const ecs_registry_t *registry, ecs_entity_t entity,
+                     ecs_entity_t component, void *out);
   void ecs_step(ecs_registry_t *registry);
+  void ecs_step_delta(ecs_registry_t *registry, float delta_time);
   void *ecs_view(ecs_view_t view, uint32_t row, uint32_t column);
+  void *ecs_view_column(ecs_view_t view, uint32_t column);
+  void *ecs_view_field(ecs_view_t view, uint32_t row, uint32_t column,
+                       uint32_t field);
 
 #define ECS_COMPONENT(registry, T) ecs_component(registry, sizeof(T));
+#define ECS_FIELD(T, member)                                                   \
+  ((ecs_field_t){offsetof(T, member), sizeof(((T *)0)->member)})
+#define ECS_COMPONENT_SPLIT(registry, component, n, ...)                       \
+  ecs_component_split(registry, component, n, (ecs_field_t[]){__VA_ARGS__})
 #define ECS_SYSTEM(registry, system, n, ...)                                   \
   ecs_system(registry, ecs_signature_new_n(n, __VA_ARGS__), system)
+#define ECS_CHUNK_SYSTEM(registry, system, n, ...)                             \
+  ecs_system_chunk(registry, ecs_signature_new_n(n, __VA_ARGS__), system)
+
+  // -- TYPED SYSTEMS ----------------------------------------------------------
+  // ECS_SYSTEM_DEF generates a chunk system that hands its body typed restrict
+  // pointers to each column instead of a view. components are listed as
+  // (type, name) pairs, in the same order as the system signature.
+  //
+  //   ECS_SYSTEM_DEF(Move, (Position, p), (Velocity, v)) {
+  //     for (uint32_t i = 0; i < count; i++) {
+  //       p[i].x += v[i].x;
+  //     }
+  //   }
+  //
+  //   ECS_TYPED_SYSTEM(registry, Move, pos_component, vel_component);
+
+#ifdef __cplusplus
+#define ECS_RESTRICT __restrict
+#else
+#define ECS_RESTRICT restrict
+#endif
+
+#define ECS_CONCAT(a, b) ECS_CONCAT_(a, b)
+#define ECS_CONCAT_(a, b) a##b
+#define ECS_NARGS(...) ECS_NARGS_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define ECS_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+#define ECS_TYPED_TYPE(T, name) T
+#define ECS_TYPED_DECL(T, name) T *ECS_RESTRICT name
+#define ECS_TYPED_PARAM(i, pair) ECS_TYPED_DECL pair
+#define ECS_TYPED_ARG(i, pair) (ECS_TYPED_TYPE pair *)ecs_view_column(view, i)
+
+#define ECS_TYPED_MAP_1(m, a) m(0, a)
+#define ECS_TYPED_MAP_2(m, a, b) ECS_TYPED_MAP_1(m, a), m(1, b)
+#define ECS_TYPED_MAP_3(m, a, b, c) ECS_TYPED_MAP_2(m, a, b), m(2, c)
+#define ECS_TYPED_MAP_4(m, a, b, c, d) ECS_TYPED_MAP_3(m, a, b, c), m(3, d)
+#define ECS_TYPED_MAP_5(m, a, b, c, d, e)                                      \
+  ECS_TYPED_MAP_4(m, a, b, c, d), m(4, e)
+#define ECS_TYPED_MAP_6(m, a, b, c, d, e, f)                                   \
+  ECS_TYPED_MAP_5(m, a, b, c, d, e), m(5, f)
+#define ECS_TYPED_MAP_7(m, a, b, c, d, e, f, g)                                \
+  ECS_TYPED_MAP_6(m, a, b, c, d, e, f), m(6, g)
+#define ECS_TYPED_MAP_8(m, a, b, c, d, e, f, g, h)                             \
+  ECS_TYPED_MAP_7(m, a, b, c, d, e, f, g), m(7, h)
+#define ECS_TYPED_MAP(m, ...)                                                  \
+  ECS_CONCAT(ECS_TYPED_MAP_, ECS_NARGS(__VA_ARGS__))(m, __VA_ARGS__)
+
+#define ECS_SYSTEM_DEF(name, ...)                                              \
+  static void name##_body(uint32_t count,                                      \
+                          ECS_TYPED_MAP(ECS_TYPED_PARAM, __VA_ARGS__));        \
+  void name(ecs_view_t view, uint32_t count) {                                 \
+    name##_body(count, ECS_TYPED_MAP(ECS_TYPED_ARG, __VA_ARGS__));             \
+  }                                                                            \
+  static void name##_body(uint32_t count,                                      \
+                          ECS_TYPED_MAP(ECS_TYPED_PARAM, __VA_ARGS__))
+
+#define ECS_TYPED_SYSTEM(registry, system, ...)                                \
+  ecs_system_chunk(                                                            \
+      registry,                                                                \
+      ecs_signature_new_n(ECS_NARGS(__VA_ARGS__), __VA_ARGS__), system)
+
+  // -- KERNELS ----------------------------------------------------------------
+  // float array math for chunk systems, run on component columns directly.
+  // the widest instruction set supported by the cpu is picked on first use.
+
+  typedef enum ecs_simd_t {
+    ECS_SIMD_SCALAR,
+    ECS_SIMD_SSE,
+    ECS_SIMD_AVX2,
+  } ecs_simd_t;
+
+  ecs_simd_t ecs_kernel_simd(void);
+  ecs_simd_t ecs_kernel_select(ecs_simd_t max);
+  void ecs_kernel_axpy(float *y, const float *x, float a, uint32_t n);
+  void ecs_kernel_scale(float *x, float a, uint32_t n);
+  void ecs_kernel_clamp(float *x, float lo, float hi, uint32_t n);
+  void ecs_kernel_lerp(float *x, const float *target, float t, uint32_t n);
+
+  // -- REPLICATION ------------------------------------------------------------
+  // bit-packed deltas of selected components (at most 32, each at most 128
+  // bytes) against a baseline of the last values sent. the server encodes with
+  // one baseline per client and the client decodes with its own, created with
+  // the same components.
+
+  typedef struct ecs_baseline_t ecs_baseline_t;
+
+  ecs_baseline_t *ecs_baseline(const ecs_registry_t *registry,
+                               const ecs_entity_t *components, uint32_t count);
+  void ecs_baseline_free(ecs_baseline_t *baseline);
+  ecs_entity_t ecs_baseline_local(const ecs_baseline_t *baseline,
+                                  ecs_entity_t remote);
+  size_t ecs_delta_encode(const ecs_registry_t *registry,
+                          ecs_baseline_t *baseline,
+                          const ecs_entity_t *entities, uint32_t count,
+                          void *out, size_t capacity);
+  bool ecs_delta_decode(ecs_registry_t *registry, ecs_baseline_t *baseline,
+                        const void *data, size_t size);
+
+  // interest management: per observer lists of the entities that are relevant
+  // and whose interest columns changed since that observer's last collect.
+  // observers can be limited to a radius around a point of the position
+  // component (whose first two fields are float x and y) and to rows a filter
+  // accepts. ecs_interest_left returns the entities a collect found were no
+  // longer relevant, whether they failed those checks or a rollback took them
+  // away, so they can be dropped on the client.
+
+  typedef struct ecs_interest_t ecs_interest_t;
+  typedef bool (*ecs_relevant_fn)(ecs_view_t view, uint32_t row, void *ctx);
+
+  ecs_interest_t *ecs_interest(ecs_registry_t *registry,
+                               ecs_signature_t *signature,
+                               ecs_entity_t position);
+  void ecs_interest_free(ecs_interest_t *interest);
+  uint32_t ecs_interest_observer(ecs_interest_t *interest);
+  void ecs_interest_radius(ecs_interest_t *interest, uint32_t observer, float x,
+                           float y, float radius);
+  void ecs_interest_filter(ecs_interest_t *interest, uint32_t observer,
+                           ecs_relevant_fn filter, void *ctx);
+  void ecs_interest_refresh(ecs_interest_t *interest, uint32_t observer);
+  uint32_t ecs_interest_collect(ecs_interest_t *interest, uint32_t observer,
+                                ecs_entity_t *out, uint32_t capacity);
+  uint32_t ecs_interest_left(ecs_interest_t *interest, uint32_t observer,
+                             ecs_entity_t *out, uint32_t capacity);
+
+  // -- ROLLBACK ---------------------------------------------------------------
+  // a ring of snapshots for restoring the registry to a recent tick and
+  // stepping it forward again. snapshots are kept by tick % size.
+
+  typedef struct ecs_rollback_t ecs_rollback_t;
+  typedef void (*ecs_input_fn)(ecs_registry_t *registry, uint64_t tick,
+                               void *ctx);
+
+  ecs_rollback_t *ecs_rollback(ecs_registry_t *registry, uint32_t size);
+  void ecs_rollback_free(ecs_rollback_t *rollback);
+  void ecs_rollback_save(ecs_rollback_t *rollback, uint64_t tick);
+  bool ecs_rollback_restore(ecs_rollback_t *rollback, uint64_t tick);
+  bool ecs_resimulate(ecs_rollback_t *rollback, uint64_t from, uint64_t to,
+                      float delta_time, ecs_input_fn input, void *ctx);
+
+  // -- SPATIAL ----------------------------------------------------------------
+  // a spatial hash over a position component, updated from change ticks before
+  // each query. queries write up to capacity entities and return the total.
+
+  typedef struct ecs_spatial_t ecs_spatial_t;
+
+  ecs_spatial_t *ecs_spatial(ecs_registry_t *registry, ecs_entity_t position,
+                             float cell_size);
+  void ecs_spatial_free(ecs_spatial_t *spatial);
+  uint32_t ecs_spatial_radius(ecs_spatial_t *spatial, float x, float y,
+                              float radius, ecs_entity_t *out,
+                              uint32_t capacity);
+  uint32_t ecs_spatial_aabb(ecs_spatial_t *spatial, float min_x, float min_y,
+                            float max_x, float max_y, ecs_entity_t *out,
+                            uint32_t capacity);
+
+  // -- INDICES ----------------------------------------------------------------
+  // secondary indices from the value of a component field (1, 2, 4 or 8 bytes)
+  // to the entities that have it. hashed indices find exact values, sorted ones
+  // also find ranges. lookups write up to capacity entities and return the
+  // total. indices are freed with their registry if not freed before.
+
+  typedef enum ecs_key_t {
+    ECS_KEY_UNSIGNED,
+    ECS_KEY_SIGNED,
+    ECS_KEY_FLOAT,
+  } ecs_key_t;
+
+  typedef struct ecs_index_t ecs_index_t;
+
+  // offset and size of a field, for the index constructors
+#define ECS_KEY_FIELD(T, field) offsetof(T, field), sizeof(((T *)0)->field)
+
+  ecs_index_t *ecs_index_hash(ecs_registry_t *registry, ecs_entity_t component,
+                              size_t offset, size_t size, ecs_key_t kind);
+  ecs_index_t *ecs_index_sorted(ecs_registry_t *registry,
+                                ecs_entity_t component, size_t offset,
+                                size_t size, ecs_key_t kind);
+  void ecs_index_free(ecs_index_t *index);
+  ecs_entity_t ecs_index_find(ecs_index_t *index, const void *value);
+  uint32_t ecs_index_find_all(ecs_index_t *index, const void *value,
+                              ecs_entity_t *out, uint32_t capacity);
+  uint32_t ecs_index_range(ecs_index_t *index, const void *min,
+                           const void *max, ecs_entity_t *out,
+                           uint32_t capacity);
+
+  // -- SORTING ----------------------------------------------------------------
+  // reorders the rows of every archetype with a component by its value, for
+  // ecs_query_each_sorted to merge. not for deterministic registries.
+
+  typedef int (*ecs_compare_fn)(const void *a, const void *b);
+
+  void ecs_sort(ecs_registry_t *registry, ecs_entity_t component,
+                ecs_compare_fn compare);
+  void ecs_sort_by_key(ecs_registry_t *registry, ecs_entity_t component,
+                       size_t offset, size_t size, ecs_key_t kind);
+  void ecs_query_each_sorted(const ecs_registry_t *registry,
+                             ecs_query_t *query, uint32_t column,
+                             ecs_compare_fn compare, ecs_each_fn fn,
+                             void *ctx);
+
+  // -- GROUPS -----------------------------------------------------------------
+  // an owning group stores the signature's components, for every archetype
+  // that has them all, in one contiguous array per component, so iterating it
+  // walks memory in order. a component can be owned by one group, and the
+  // components cannot be split. an archetype that matches several groups is
+  // owned by the first to find it and visited in place by the others. each
+  // archetype's segment starts on a cache line. groups are freed with their
+  // registry if not freed before.
+
+  typedef struct ecs_group_t ecs_group_t;
+
+  ecs_group_t *ecs_group(ecs_registry_t *registry, ecs_signature_t *sig);
+  void ecs_group_free(ecs_group_t *group);
+  void ecs_group_compact(ecs_group_t *group);
+  void ecs_group_each(ecs_group_t *group, ecs_each_fn fn, void *ctx);
+
+  // -- COLD COLUMNS -----------------------------------------------------------
+  // systems count the rows they run over in each column. ecs_compress_cold
+  // packs the columns that were rarely visited as runs of equal rows, and they
+  // are unpacked by whatever touches them next. read phases cannot start while
+  // columns are packed; ecs_inflate unpacks all of them.
+
+  uint64_t ecs_accesses(const ecs_registry_t *registry,
+                        ecs_entity_t component);
+  uint32_t ecs_compress_cold(ecs_registry_t *registry, uint64_t max_accesses);
+  void ecs_inflate(ecs_registry_t *registry);
+  size_t ecs_cold_bytes(const ecs_registry_t *registry);
 
 #ifdef __cplusplus
 } // extern "C"
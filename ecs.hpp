@@ -0,0 +1,110 @@
+#ifndef ECS_HPP
+#define ECS_HPP
+
+// optional c++17 wrapper around ecs.h. component ids are looked up by type, and
+// each<Ts...>() resolves columns once per archetype and runs a loop over typed
+// arrays that the compiler can inline and vectorize.
+
+#include "ecs.h"
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+
+namespace ecs {
+
+class registry {
+public:
+  registry() : handle_(ecs_init()) {}
+
+  ~registry() {
+    for (auto &query : queries_) {
+      ecs_query_free(query.second);
+    }
+    ecs_destroy(handle_);
+  }
+
+  registry(const registry &) = delete;
+  registry &operator=(const registry &) = delete;
+
+  ecs_registry_t *handle() const { return handle_; }
+
+  ecs_entity_t entity() { return ecs_entity(handle_); }
+
+  template <typename T> ecs_entity_t component() {
+    using U = std::remove_cv_t<T>;
+    static_assert(std::is_trivially_copyable_v<U>,
+                  "components are copied with memcpy");
+
+    auto found = components_.find(typeid(U));
+    if (found != components_.end()) {
+      return found->second;
+    }
+
+    ecs_entity_t id = ecs_component(handle_, sizeof(U));
+    components_.emplace(typeid(U), id);
+    return id;
+  }
+
+  template <typename T> void attach(ecs_entity_t entity) {
+    ecs_attach(handle_, entity, component<T>());
+  }
+
+  template <typename T> void set(ecs_entity_t entity, const T &value) {
+    ecs_set(handle_, entity, component<T>(), &value);
+  }
+
+  // calls f(Ts &...) for every entity that has all of the components. const
+  // components are only read, so their columns keep their change ticks.
+  template <typename... Ts, typename F> void each(F &&f) {
+    using Fn = std::remove_reference_t<F>;
+    ecs_query_each(handle_, query<Ts...>(), &each_chunk<Fn, Ts...>,
+                   const_cast<void *>(static_cast<const void *>(&f)));
+  }
+
+  void step() { ecs_step(handle_); }
+
+private:
+  template <typename... Ts> ecs_query_t *query() {
+    using key = std::tuple<Ts...>;
+
+    auto found = queries_.find(typeid(key));
+    if (found != queries_.end()) {
+      return found->second;
+    }
+
+    ecs_signature_t *sig = ecs_signature_new_n(
+        sizeof...(Ts), (std::is_const_v<Ts> ? ECS_READ(component<Ts>())
+                                             : component<Ts>())...);
+    ecs_query_t *query = ecs_query(handle_, sig);
+    queries_.emplace(typeid(key), query);
+    return query;
+  }
+
+  template <typename F, typename... Ts>
+  static void each_chunk(ecs_view_t view, uint32_t count, void *ctx) {
+    each_rows<F, Ts...>(view, count, *static_cast<F *>(ctx),
+                        std::index_sequence_for<Ts...>{});
+  }
+
+  template <typename F, typename... Ts, std::size_t... Is>
+  static void each_rows(ecs_view_t view, uint32_t count, F &f,
+                        std::index_sequence<Is...>) {
+    std::tuple<Ts *...> columns{
+        static_cast<Ts *>(ecs_view_column(view, Is))...};
+    for (uint32_t i = 0; i < count; i++) {
+      f(std::get<Is>(columns)[i]...);
+    }
+  }
+
+  ecs_registry_t *handle_;
+  std::unordered_map<std::type_index, ecs_entity_t> components_;
+  std::unordered_map<std::type_index, ecs_query_t *> queries_;
+};
+
+} // namespace ecs
+
+#endif // ECS_HPP
@@ -2,6 +2,12 @@
 #include "greatest.h"
 
 #include <alloca.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 TEST map_empty() {
   ecs_map_t *map = ECS_MAP(intptr, int, int, 16);
@@ -104,6 +110,33 @@ TEST map_remove_a_lot(int count) {
   PASS();
 }
 
+// removing leaves tombstones, and setting reuses them
+TEST map_churn() {
+  ecs_map_t *map = ECS_MAP(intptr, int, int, 16);
+  for (int i = 1; i <= 200; i++) {
+    ecs_map_set(map, (void *)(uintptr_t)i, &i);
+  }
+
+  for (int round = 0; round < 5000; round++) {
+    int removed = round * 37 % 200 + 1;
+    int added = round * 53 % 200 + 1;
+    ecs_map_remove(map, (void *)(uintptr_t)removed);
+    ecs_map_set(map, (void *)(uintptr_t)removed, &removed);
+    ecs_map_remove(map, (void *)(uintptr_t)added);
+    ecs_map_set(map, (void *)(uintptr_t)added, &added);
+  }
+
+  ASSERT_EQ(ecs_map_len(map), 200);
+  for (int i = 1; i <= 200; i++) {
+    int *value = ecs_map_get(map, (void *)(uintptr_t)i);
+    ASSERT(value != NULL);
+    ASSERT_EQ(*value, i);
+  }
+
+  ecs_map_free(map);
+  PASS();
+}
+
 TEST map_string_keys() {
   ecs_map_t *map = ECS_MAP(string, char *, int, 16);
   ecs_map_set(map, "foo", &(int){10});
@@ -156,6 +189,7 @@ SUITE(map) {
     RUN_TEST1(map_set_a_lot, i);
     RUN_TEST1(map_remove_a_lot, i);
   }
+  RUN_TEST(map_churn);
   RUN_TEST(map_string_keys);
   RUN_TEST(map_string_keys_struct_values);
 }
@@ -451,15 +485,2215 @@ TEST ecs_from_bench(int context[]) {
   PASS();
 }
 
-SUITE(ecs) {
-  RUN_TEST(ecs_run_system_loop);
-  RUN_TEST(ecs_run_system);
-  RUN_TEST(ecs_minimal);
-  RUN_TEST(ecs_register);
-  RUN_TEST(ecs_create_entity);
-  RUN_TEST(ecs_attach_component);
-  RUN_TEST(ecs_set_component_data);
-  RUN_TEST1(ecs_from_bench, ((int[2]){10, 1000}));
+// runs fn in a child process and tells whether it aborted
+static bool aborts(void (*fn)(void)) {
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid == 0) {
+    freopen("/dev/null", "w", stderr);
+    fn();
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+typedef struct {
+  float x;
+  float y;
+  int layer;
+} Transform;
+
+static int split_rows, split_total, split_mismatches;
+static ecs_registry_t *split_registry;
+static ecs_entity_t split_system, split_late;
+
+void skip_chunk(ecs_view_t view, uint32_t count) {
+  (void)view;
+  (void)count;
+}
+
+static void parallel_split(void) {
+  ecs_system_parallel(split_registry, split_system, 0);
+}
+
+static void split_parallel(void) {
+  ECS_COMPONENT_SPLIT(split_registry, split_late, 3, ECS_FIELD(Transform, x),
+                      ECS_FIELD(Transform, y), ECS_FIELD(Transform, layer));
+}
+
+void check_split(ecs_view_t view, unsigned int row) {
+  float *x = ecs_view_field(view, row, 0, 0);
+  float *y = ecs_view_field(view, row, 0, 1);
+  int *layer = ecs_view_field(view, row, 0, 2);
+
+  if (*y != *x * 2.0f || *layer != (int)*x) {
+    split_mismatches++;
+  }
+
+  // fields of neighbouring rows sit next to each other
+  if (row > 0 && (float *)ecs_view_field(view, row - 1, 0, 0) != x - 1) {
+    split_mismatches++;
+  }
+
+  split_rows++;
+  split_total += *layer;
+}
+
+TEST ecs_split_component() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t transform_component = ECS_COMPONENT(registry, Transform);
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ECS_COMPONENT_SPLIT(registry, transform_component, 3,
+                      ECS_FIELD(Transform, x), ECS_FIELD(Transform, y),
+                      ECS_FIELD(Transform, layer));
+
+  ecs_entity_t entities[40];
+  for (int i = 0; i < 40; i++) {
+    entities[i] = ecs_entity(registry);
+    ecs_attach(registry, entities[i], transform_component);
+    ecs_set(registry, entities[i], transform_component,
+            &(Transform){(float)i, (float)i * 2.0f, i});
+    ecs_attach(registry, entities[i], int_component);
+    ecs_set(registry, entities[i], int_component, &i);
+  }
+
+  split_rows = split_total = split_mismatches = 0;
+  ECS_SYSTEM(registry, check_split, 2, transform_component, int_component);
+  ecs_step(registry);
+
+  ASSERT_EQ(split_rows, 40);
+  ASSERT_EQ(split_total, 780);
+  ASSERT_EQ(split_mismatches, 0);
+
+  // ecs_get has no struct to point at, so the fields are gathered instead
+  Transform transform;
+  ASSERT(ecs_get_split(registry, entities[7], transform_component, &transform));
+  ASSERT_EQ(transform.x, 7.0f);
+  ASSERT_EQ(transform.y, 14.0f);
+  ASSERT_EQ(transform.layer, 7);
+  int value;
+  ASSERT(ecs_get_split(registry, entities[7], int_component, &value));
+  ASSERT_EQ(value, 7);
+  ecs_entity_t bare = ecs_entity(registry);
+  ecs_attach(registry, bare, int_component);
+  ASSERT_FALSE(ecs_get_split(registry, bare, transform_component, &transform));
+
+  // parallel chunk ranges offset whole rows, so split components are refused
+  // whichever comes first
+  split_registry = registry;
+  split_system = ECS_CHUNK_SYSTEM(registry, skip_chunk, 1, transform_component);
+  ASSERT(aborts(parallel_split));
+  split_late = ECS_COMPONENT(registry, Transform);
+  ecs_system_parallel(registry,
+                      ECS_CHUNK_SYSTEM(registry, skip_chunk, 1, split_late), 0);
+  ASSERT(aborts(split_parallel));
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct {
+  double value;
+  char flag;
+} Padded;
+
+void sum_padded(ecs_view_t view, uint32_t count, void *ctx) {
+  Padded *sum = ctx;
+  for (uint32_t i = 0; i < count; i++) {
+    sum->value += *(double *)ecs_view_field(view, i, 0, 0);
+    sum->flag += *(char *)ecs_view_field(view, i, 0, 1) == 'a';
+  }
+}
+
+TEST ecs_split_buffered_rollback() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t padded_component = ECS_COMPONENT(registry, Padded);
+  ECS_COMPONENT_SPLIT(registry, padded_component, 2,
+                      ECS_FIELD(Padded, value), ECS_FIELD(Padded, flag));
+  ecs_component_buffered(registry, padded_component);
+
+  ecs_entity_t entities[40];
+  for (int i = 0; i < 40; i++) {
+    entities[i] = ecs_entity(registry);
+    ecs_attach(registry, entities[i], padded_component);
+    ecs_set(registry, entities[i], padded_component, &(Padded){i, 'a'});
+  }
+
+  // split rows are packed without the struct's padding, and restoring
+  // refreshes the front buffer at that size
+  ecs_rollback_t *rollback = ecs_rollback(registry, 2);
+  ecs_rollback_save(rollback, 0);
+  ecs_set(registry, entities[39], padded_component, &(Padded){-1.0, 'b'});
+  ecs_step(registry);
+  ASSERT(ecs_rollback_restore(rollback, 0));
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, padded_component));
+  Padded sum = {0.0, 0};
+  ecs_query_each_front(registry, query, sum_padded, &sum);
+  ASSERT_EQ(sum.value, 780.0);
+  ASSERT_EQ(sum.flag, 40);
+
+  ecs_query_free(query);
+  ecs_rollback_free(rollback);
+  ecs_destroy(registry);
+  PASS();
+}
+
+static int matched_rows;
+
+void count_rows(ecs_view_t view, unsigned int row) {
+  (void)view;
+  (void)row;
+  matched_rows++;
+}
+
+TEST ecs_system_matches_every_archetype() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t a = ECS_COMPONENT(registry, int);
+  ecs_entity_t b = ECS_COMPONENT(registry, int);
+  ecs_entity_t c = ECS_COMPONENT(registry, int);
+
+  ecs_entity_t e1 = ecs_entity(registry);
+  ecs_attach(registry, e1, a);
+  ecs_attach(registry, e1, b);
+  ecs_entity_t e2 = ecs_entity(registry);
+  ecs_attach(registry, e2, b);
+  ecs_attach(registry, e2, c);
+  ecs_entity_t e3 = ecs_entity(registry);
+  ecs_attach(registry, e3, c);
+
+  matched_rows = 0;
+  ECS_SYSTEM(registry, count_rows, 1, b);
+  ecs_step(registry);
+  ASSERT_EQ(matched_rows, 2);
+
+  // archetypes created after the system was registered are picked up too
+  ecs_entity_t e4 = ecs_entity(registry);
+  ecs_attach(registry, e4, c);
+  ecs_attach(registry, e4, a);
+  ecs_attach(registry, e4, b);
+  matched_rows = 0;
+  ecs_step(registry);
+  ASSERT_EQ(matched_rows, 3);
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct {
+  float x;
+  float y;
+} Vec2;
+
+void move_chunk(ecs_view_t view, unsigned int count) {
+  Vec2 *p = ecs_view_column(view, 0);
+  Vec2 *v = ecs_view_column(view, 1);
+  ecs_kernel_axpy((float *)p, (const float *)v, 0.5f, count * 2);
+}
+
+static float chunk_sum;
+
+void sum_chunk(ecs_view_t view, unsigned int count) {
+  Vec2 *p = ecs_view_column(view, 0);
+  for (unsigned int i = 0; i < count; i++) {
+    chunk_sum += p[i].x + p[i].y;
+  }
+}
+
+TEST ecs_chunk_system() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t pos_component = ECS_COMPONENT(registry, Vec2);
+  ecs_entity_t vel_component = ECS_COMPONENT(registry, Vec2);
+  ecs_entity_t tag_component = ECS_COMPONENT(registry, int);
+
+  for (int i = 0; i < 100; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, pos_component);
+    ecs_attach(registry, e, vel_component);
+    if (i % 2 == 0) {
+      ecs_attach(registry, e, tag_component);
+    }
+    ecs_set(registry, e, pos_component, &(Vec2){0.0f, 0.0f});
+    ecs_set(registry, e, vel_component, &(Vec2){1.0f, 2.0f});
+  }
+
+  ECS_CHUNK_SYSTEM(registry, move_chunk, 2, pos_component, vel_component);
+  ecs_step(registry);
+  ecs_step(registry);
+
+  // systems run in registration order, so this step moves once more first
+  chunk_sum = 0.0f;
+  ECS_CHUNK_SYSTEM(registry, sum_chunk, 1, pos_component);
+  ecs_step(registry);
+  ASSERT_IN_RANGE(450.0f, chunk_sum, 0.001f);
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+ECS_SYSTEM_DEF(typed_move, (Vec2, p), (const Vec2, v)) {
+  for (uint32_t i = 0; i < count; i++) {
+    p[i].x += v[i].x;
+    p[i].y += v[i].y;
+  }
+}
+
+ECS_SYSTEM_DEF(typed_sum, (const Vec2, p)) {
+  for (uint32_t i = 0; i < count; i++) {
+    chunk_sum += p[i].x + p[i].y;
+  }
+}
+
+TEST ecs_typed_system() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t pos_component = ECS_COMPONENT(registry, Vec2);
+  ecs_entity_t vel_component = ECS_COMPONENT(registry, Vec2);
+
+  for (int i = 0; i < 50; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, pos_component);
+    ecs_attach(registry, e, vel_component);
+    ecs_set(registry, e, pos_component, &(Vec2){1.0f, 1.0f});
+    ecs_set(registry, e, vel_component, &(Vec2){(float)i, 1.0f});
+  }
+
+  chunk_sum = 0.0f;
+  ECS_TYPED_SYSTEM(registry, typed_move, pos_component, vel_component);
+  ECS_TYPED_SYSTEM(registry, typed_sum, pos_component);
+  ecs_step(registry);
+  ASSERT_IN_RANGE(1375.0f, chunk_sum, 0.001f);
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+void sum_each(ecs_view_t view, uint32_t count, void *ctx) {
+  int *total = ctx;
+  int *x = ecs_view_column(view, 0);
+  for (uint32_t i = 0; i < count; i++) {
+    *total += x[i];
+  }
+}
+
+TEST ecs_query_each_archetype() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t tag_component = ECS_COMPONENT(registry, char);
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+
+  for (int i = 0; i < 10; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, int_component);
+    if (i % 3 == 0) {
+      ecs_attach(registry, e, tag_component);
+    }
+    ecs_set(registry, e, int_component, &i);
+  }
+
+  int total = 0;
+  ecs_query_each(registry, query, sum_each, &total);
+  ASSERT_EQ(total, 45);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct {
+  int id;
+  int runs;
+  float time;
+} Clock;
+
+void tick_clock(ecs_view_t view, unsigned int row) {
+  Clock *clock = ecs_view(view, row, 0);
+  clock->runs++;
+  clock->time += view.delta_time;
+}
+
+static Clock clocks[4];
+
+void read_clocks(ecs_view_t view, unsigned int row) {
+  Clock *clock = ecs_view(view, row, 0);
+  clocks[clock->id] = *clock;
+}
+
+TEST ecs_system_timing() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t every_step = ECS_COMPONENT(registry, Clock);
+  ecs_entity_t rate = ECS_COMPONENT(registry, Clock);
+  ecs_entity_t staggered = ECS_COMPONENT(registry, Clock);
+  ecs_entity_t fixed = ECS_COMPONENT(registry, Clock);
+  ecs_entity_t components[4] = {every_step, rate, staggered, fixed};
+
+  for (int i = 0; i < 4; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, components[i]);
+    ecs_set(registry, e, components[i], &(Clock){i, 0, 0.0f});
+  }
+
+  ECS_SYSTEM(registry, tick_clock, 1, every_step);
+  ecs_entity_t sys = ECS_SYSTEM(registry, tick_clock, 1, rate);
+  ecs_system_interval(registry, sys, 0.25f, 0.0f);
+  sys = ECS_SYSTEM(registry, tick_clock, 1, staggered);
+  ecs_system_interval(registry, sys, 0.25f, 0.125f);
+  sys = ECS_SYSTEM(registry, tick_clock, 1, fixed);
+  ecs_system_fixed(registry, sys, 0.0625f, 0.0f);
+
+  for (int i = 0; i < 8; i++) {
+    ecs_step_delta(registry, 0.125f);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    ECS_SYSTEM(registry, read_clocks, 1, components[i]);
+  }
+  ecs_step(registry);
+
+  ASSERT_EQ(clocks[0].runs, 9);
+  ASSERT_IN_RANGE(1.0f, clocks[0].time, 0.0001f);
+  ASSERT_EQ(clocks[1].runs, 4); // every other step
+  ASSERT_IN_RANGE(1.0f, clocks[1].time, 0.0001f);
+  ASSERT_EQ(clocks[2].runs, 3); // every other step, one step later
+  ASSERT_IN_RANGE(0.875f, clocks[2].time, 0.0001f);
+  ASSERT_EQ(clocks[3].runs, 16);
+  ASSERT_IN_RANGE(1.0f, clocks[3].time, 0.0001f);
+
+  // a long hitch only catches up a bounded number of fixed steps
+  ecs_step_delta(registry, 10.0f);
+  ecs_step(registry);
+  ASSERT(clocks[3].runs > 16 && clocks[3].runs <= 32);
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+static char order[16];
+static int order_len;
+
+#define LOG_SYSTEM(name, letter)                                               \
+  void name(ecs_view_t view, unsigned int row) {                               \
+    (void)view;                                                                \
+    (void)row;                                                                 \
+    order[order_len++] = letter;                                               \
+  }
+
+LOG_SYSTEM(log_a, 'a')
+LOG_SYSTEM(log_b, 'b')
+LOG_SYSTEM(log_c, 'c')
+LOG_SYSTEM(log_d, 'd')
+LOG_SYSTEM(log_e, 'e')
+
+TEST ecs_system_order() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t e = ecs_entity(registry);
+  ecs_attach(registry, e, int_component);
+
+  ecs_entity_t render = ECS_SYSTEM(registry, log_a, 1, int_component);
+  ecs_entity_t late = ECS_SYSTEM(registry, log_b, 1, int_component);
+  ecs_entity_t early = ECS_SYSTEM(registry, log_c, 1, int_component);
+  ecs_entity_t input = ECS_SYSTEM(registry, log_d, 1, int_component);
+  ecs_entity_t update = ECS_SYSTEM(registry, log_e, 1, int_component);
+  ecs_system_phase(registry, render, ECS_RENDER_PREP);
+  ecs_system_phase(registry, input, ECS_PRE_UPDATE);
+  ecs_system_after(registry, late, update);
+  ecs_system_before(registry, early, late);
+  ecs_system_before(registry, update, early);
+
+  memset(order, 0, sizeof(order));
+  order_len = 0;
+  ecs_step(registry);
+  ecs_step(registry);
+  ASSERT_STR_EQ(order, "decbadecba");
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+TEST ecs_system_toggle_and_remove() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t e = ecs_entity(registry);
+  ecs_attach(registry, e, int_component);
+
+  ecs_entity_t a = ECS_SYSTEM(registry, log_a, 1, int_component);
+  ecs_entity_t b = ECS_SYSTEM(registry, log_b, 1, int_component);
+  ecs_entity_t c = ECS_SYSTEM(registry, log_c, 1, int_component);
+  ecs_entity_t d = ECS_SYSTEM(registry, log_d, 1, int_component);
+  ecs_system_before(registry, d, a);
+  ecs_system_after(registry, c, b);
+
+  memset(order, 0, sizeof(order));
+  order_len = 0;
+  ecs_step(registry);
+  ASSERT_STR_EQ(order, "bcda");
+
+  ecs_system_disable(registry, a);
+  ecs_step(registry);
+  ecs_system_enable(registry, a);
+  ecs_system_remove(registry, b);
+  ecs_step(registry);
+  ASSERT_STR_EQ(order, "bcdabcdcda");
+
+  // systems registered after a removal still run in registration order
+  ECS_SYSTEM(registry, log_e, 1, int_component);
+  ecs_system_remove(registry, d);
+  ecs_step(registry);
+  ASSERT_STR_EQ(order, "bcdabcdcdaace");
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+void increment(ecs_view_t view, unsigned int row) {
+  int *x = ecs_view(view, row, 0);
+  (*x)++;
+}
+
+typedef struct {
+  int total;
+  int min;
+  int max;
+} Stats;
+
+void gather_stats(ecs_view_t view, uint32_t count, void *ctx) {
+  Stats *stats = ctx;
+  int *x = ecs_view_column(view, 0);
+  for (uint32_t i = 0; i < count; i++) {
+    stats->total += x[i];
+    stats->min = x[i] < stats->min ? x[i] : stats->min;
+    stats->max = x[i] > stats->max ? x[i] : stats->max;
+  }
+}
+
+// about 200 µs of work
+void increment_slowly(ecs_view_t view, unsigned int row) {
+  clock_t until = clock() + CLOCKS_PER_SEC / 5000;
+  while (clock() < until) {
+  }
+  increment(view, row);
+}
+
+void increment_each(ecs_view_t view, uint32_t count, void *ctx) {
+  (void)ctx;
+  for (uint32_t i = 0; i < count; i++) {
+    increment(view, i);
+  }
+}
+
+TEST ecs_system_time_sliced() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t tag_component = ECS_COMPONENT(registry, char);
+
+  for (int i = 0; i < 100; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, int_component);
+    if (i % 4 == 0) {
+      ecs_attach(registry, e, tag_component);
+    }
+    ecs_set(registry, e, int_component, &(int){0});
+  }
+
+  ecs_entity_t sys = ECS_SYSTEM(registry, increment, 1, int_component);
+  ecs_system_budget(registry, sys, 30, 0);
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+
+  ecs_step(registry);
+  Stats stats = {0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 30);
+
+  // the cursor wraps around, spreading the work evenly
+  for (int i = 0; i < 9; i++) {
+    ecs_step(registry);
+  }
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 300);
+  ASSERT_EQ(stats.min, 3);
+  ASSERT_EQ(stats.max, 3);
+
+  // a generous time budget covers every row exactly once
+  ecs_system_budget(registry, sys, 0, 1000000);
+  ecs_step(registry);
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.min, 4);
+  ASSERT_EQ(stats.max, 4);
+
+  // slow rows end the slice soon after the budget runs out
+  ecs_system_disable(registry, sys);
+  ecs_entity_t slow = ECS_SYSTEM(registry, increment_slowly, 1, int_component);
+  ecs_system_budget(registry, slow, 0, 1000);
+  ecs_step(registry);
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT(stats.total > 400 && stats.total < 420);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+TEST ecs_system_strided() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t tag_component = ECS_COMPONENT(registry, char);
+
+  for (int i = 0; i < 50; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, int_component);
+    if (i % 3 == 0) {
+      ecs_attach(registry, e, tag_component);
+    }
+    ecs_set(registry, e, int_component, &(int){0});
+  }
+
+  ecs_entity_t sys = ECS_SYSTEM(registry, increment, 1, int_component);
+  ecs_system_stride(registry, sys, 4);
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+
+  ecs_step(registry);
+  Stats stats = {0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT(stats.total > 0 && stats.total < 50);
+  ASSERT_EQ(stats.max, 1);
+
+  for (int i = 0; i < 7; i++) {
+    ecs_step(registry);
+  }
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 100);
+  ASSERT_EQ(stats.min, 2);
+  ASSERT_EQ(stats.max, 2);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+#define TEST_WORKERS 4
+
+typedef struct Worker {
+  pthread_t thread;
+  uint32_t first;
+  ecs_job_fn job;
+  void *data;
+  uint32_t count;
+} Worker;
+
+static void *worker_run(void *arg) {
+  Worker *worker = arg;
+  for (uint32_t i = worker->first; i < worker->count; i += TEST_WORKERS) {
+    worker->job(worker->data, i);
+  }
+  return NULL;
+}
+
+// a throwaway executor: one thread per worker, each taking every fourth task
+static void thread_executor(ecs_job_fn job, void *data, uint32_t count,
+                            void *ctx) {
+  Worker *workers = ctx;
+  for (uint32_t i = 0; i < TEST_WORKERS; i++) {
+    workers[i] = (Worker){0, i, job, data, count};
+    pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+  }
+  for (uint32_t i = 0; i < TEST_WORKERS; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+}
+
+static void *chunk_starts[64];
+static uint32_t chunk_rows[64];
+static uint32_t chunk_count = 0;
+
+void record_chunk(ecs_view_t view, uint32_t count) {
+  uint32_t i = __atomic_fetch_add(&chunk_count, 1, __ATOMIC_RELAXED);
+  chunk_starts[i] = ecs_view_column(view, 0);
+  chunk_rows[i] = count;
+}
+
+TEST ecs_system_parallel_ranges() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ecs_component(registry, sizeof(int));
+
+  for (int i = 0; i < 10000; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, int_component);
+    ecs_set(registry, e, int_component, &(int){0});
+  }
+
+  Worker workers[TEST_WORKERS];
+  ecs_executor(registry, thread_executor, workers, TEST_WORKERS);
+
+  ecs_entity_t sys = ECS_SYSTEM(registry, increment, 1, int_component);
+  ecs_system_parallel(registry, sys, 0);
+  ecs_entity_t chunk =
+      ECS_CHUNK_SYSTEM(registry, record_chunk, 1, int_component);
+  ecs_system_parallel(registry, chunk, 0);
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+
+  // every row runs exactly once, and no two ranges share a cache line
+  ecs_step(registry);
+  Stats stats = {0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.min, 1);
+  ASSERT_EQ(stats.max, 1);
+
+  ASSERT(chunk_count > 1);
+  uint32_t rows = 0;
+  for (uint32_t i = 0; i < chunk_count; i++) {
+    ASSERT_EQ((uintptr_t)chunk_starts[i] % 64, 0);
+    rows += chunk_rows[i];
+  }
+  ASSERT_EQ(rows, 10000);
+
+  // a large grain means fewer, longer ranges
+  ecs_system_parallel(registry, chunk, 6000);
+  chunk_count = 0;
+  ecs_step(registry);
+  ASSERT_EQ(chunk_count, 2);
+
+  // without an executor the ranges run in order on the calling thread
+  ecs_executor(registry, NULL, NULL, 0);
+  ecs_step(registry);
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.min, 3);
+  ASSERT_EQ(stats.max, 3);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+#define SPAWNS_PER_THREAD 1000
+
+typedef struct Spawning {
+  pthread_t thread;
+  ecs_spawner_t *spawner;
+  ecs_entity_t ids[SPAWNS_PER_THREAD];
+} Spawning;
+
+static void *spawn_run(void *arg) {
+  Spawning *spawning = arg;
+  for (int i = 0; i < SPAWNS_PER_THREAD; i++) {
+    spawning->ids[i] = ecs_spawn(spawning->spawner);
+  }
+  return NULL;
+}
+
+static int compare_ids(const void *a, const void *b) {
+  ecs_entity_t x = *(const ecs_entity_t *)a;
+  ecs_entity_t y = *(const ecs_entity_t *)b;
+  return (x > y) - (x < y);
+}
+
+TEST ecs_spawn_from_threads() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ecs_component(registry, sizeof(int));
+
+  static Spawning spawning[TEST_WORKERS];
+  for (int i = 0; i < TEST_WORKERS; i++) {
+    spawning[i].spawner = ecs_spawner(registry);
+    pthread_create(&spawning[i].thread, NULL, spawn_run, &spawning[i]);
+  }
+  for (int i = 0; i < TEST_WORKERS; i++) {
+    pthread_join(spawning[i].thread, NULL);
+  }
+
+  // ids from different threads never collide
+  static ecs_entity_t ids[TEST_WORKERS * SPAWNS_PER_THREAD];
+  for (int i = 0; i < TEST_WORKERS; i++) {
+    memcpy(&ids[i * SPAWNS_PER_THREAD], spawning[i].ids,
+           sizeof(spawning[i].ids));
+  }
+  qsort(ids, TEST_WORKERS * SPAWNS_PER_THREAD, sizeof(ecs_entity_t),
+        compare_ids);
+  for (int i = 1; i < TEST_WORKERS * SPAWNS_PER_THREAD; i++) {
+    ASSERT(ids[i - 1] != ids[i]);
+  }
+  ASSERT(ids[0] > int_component);
+
+  // entities exist once synced, and new ids carry on past the reserved ones
+  ecs_sync(registry);
+  for (int i = 0; i < TEST_WORKERS * SPAWNS_PER_THREAD; i++) {
+    ecs_attach(registry, ids[i], int_component);
+    ecs_set(registry, ids[i], int_component, &(int){0});
+  }
+  ASSERT(ecs_entity(registry) > ids[TEST_WORKERS * SPAWNS_PER_THREAD - 1]);
+
+  ECS_SYSTEM(registry, increment, 1, int_component);
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+  ecs_step(registry);
+  Stats stats = {0, 100, 0};
+  ecs_query_each(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, TEST_WORKERS * SPAWNS_PER_THREAD);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct Reader {
+  pthread_t thread;
+  ecs_registry_t *registry;
+  ecs_entity_t component;
+  ecs_entity_t first;
+  ecs_query_t *query;
+  ecs_index_t *index;
+  uint64_t epoch;
+  int gets;
+  uint32_t ones;
+  Stats stats;
+} Reader;
+
+static void *read_run(void *arg) {
+  Reader *reader = arg;
+  reader->epoch = ecs_read_begin(reader->registry);
+  for (ecs_entity_t e = reader->first; e < reader->first + 100; e++) {
+    const int *value = ecs_get(reader->registry, e, reader->component);
+    reader->gets += *value;
+  }
+  ecs_query_each(reader->registry, reader->query, gather_stats,
+                 &reader->stats);
+  reader->ones = ecs_index_find_all(reader->index, &(int){1}, NULL, 0);
+  ecs_read_end(reader->registry);
+  return NULL;
+}
+
+TEST ecs_read_phase() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t tag_component = ecs_component(registry, sizeof(int));
+
+  ecs_entity_t first = ecs_entity(registry);
+  ecs_attach(registry, first, int_component);
+  ecs_set(registry, first, int_component, &(int){1});
+  for (int i = 1; i < 100; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, int_component);
+    ecs_set(registry, e, int_component, &(int){1});
+  }
+  ASSERT_EQ(ecs_get(registry, first, tag_component), NULL);
+
+  // structural changes move the epoch, plain writes do not
+  uint64_t epoch = ecs_epoch(registry);
+  ecs_set(registry, first, int_component, &(int){1});
+  ASSERT_EQ(ecs_epoch(registry), epoch);
+  ecs_attach(registry, first, tag_component);
+  ASSERT(ecs_epoch(registry) != epoch);
+
+  ASSERT_EQ(ecs_read_begin(registry), ecs_epoch(registry));
+  ecs_read_end(registry);
+
+  // the index is behind, and whichever reader begins first catches it up
+  // while the others wait
+  ecs_index_t *index = ecs_index_sorted(registry, int_component, 0,
+                                        sizeof(int), ECS_KEY_SIGNED);
+  ecs_set(registry, first, int_component, &(int){2});
+  ecs_changed(registry, int_component);
+
+  Reader readers[TEST_WORKERS];
+  for (int i = 0; i < TEST_WORKERS; i++) {
+    readers[i] = (Reader){.registry = registry,
+                          .component = int_component,
+                          .first = first,
+                          .index = index,
+                          .stats = (Stats){0, 100, 0}};
+    readers[i].query =
+        ecs_query(registry, ecs_signature_new_n(1, int_component));
+    pthread_create(&readers[i].thread, NULL, read_run, &readers[i]);
+  }
+  for (int i = 0; i < TEST_WORKERS; i++) {
+    pthread_join(readers[i].thread, NULL);
+  }
+
+  for (int i = 0; i < TEST_WORKERS; i++) {
+    ASSERT_EQ(readers[i].epoch, ecs_epoch(registry));
+    ASSERT_EQ(readers[i].gets, 101);
+    ASSERT_EQ(readers[i].ones, 99);
+    ASSERT_EQ(readers[i].stats.total, 101);
+    ecs_query_free(readers[i].query);
+  }
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+static ecs_registry_t *peek_registry;
+static ecs_entity_t peek_entity, peek_component;
+static int seen_front, seen_back;
+
+void peek_buffers(ecs_view_t view, uint32_t row) {
+  (void)view;
+  (void)row;
+  seen_front = *(const int *)ecs_get_front(peek_registry, peek_entity,
+                                           peek_component);
+  seen_back =
+      *(const int *)ecs_get(peek_registry, peek_entity, peek_component);
+}
+
+typedef struct FrontReader {
+  pthread_t thread;
+  ecs_registry_t *registry;
+  ecs_query_t *query;
+  int torn;
+  int done;
+} FrontReader;
+
+// every step adds one to each of the 21 rows, which started at 5 in total
+static void *front_run(void *arg) {
+  FrontReader *reader = arg;
+  for (int i = 0; i < 50; i++) {
+    uint64_t generation = ecs_front_begin(reader->registry);
+    Stats stats = {0, 100, 0};
+    ecs_query_each_front(reader->registry, reader->query, gather_stats,
+                         &stats);
+    reader->torn += (uint64_t)stats.total != 5 + 21 * generation;
+    ecs_front_end(reader->registry);
+  }
+  __atomic_store_n(&reader->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+TEST ecs_double_buffered_component() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t tag_component = ecs_component(registry, sizeof(int));
+  ecs_component_buffered(registry, int_component);
+
+  ecs_entity_t e = ecs_entity(registry);
+  ecs_attach(registry, e, int_component);
+  ecs_set(registry, e, int_component, &(int){5});
+  for (int i = 0; i < 20; i++) {
+    ecs_entity_t other = ecs_entity(registry);
+    ecs_attach(registry, other, int_component);
+    ecs_set(registry, other, int_component, &(int){0});
+  }
+
+  peek_registry = registry;
+  peek_entity = e;
+  peek_component = int_component;
+  ecs_entity_t inc = ECS_SYSTEM(registry, increment, 1, int_component);
+  ecs_entity_t peek = ECS_SYSTEM(registry, peek_buffers, 1, tag_component);
+  ecs_system_after(registry, peek, inc);
+  ecs_attach(registry, e, tag_component);
+
+  // systems write the back buffer while the front keeps last step's values
+  ecs_step(registry);
+  ASSERT_EQ(seen_front, 5);
+  ASSERT_EQ(seen_back, 6);
+  ASSERT_EQ(*(const int *)ecs_get_front(registry, e, int_component), 6);
+
+  ecs_step(registry);
+  ASSERT_EQ(seen_front, 6);
+  ASSERT_EQ(seen_back, 7);
+
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+  Stats stats = {0, 100, 0};
+  ecs_query_each_front(registry, query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 7 + 20 * 2);
+
+  // a reader thread only ever sees whole steps, however they interleave
+  FrontReader reader = {0, registry, query, 0, 0};
+  pthread_create(&reader.thread, NULL, front_run, &reader);
+  while (!__atomic_load_n(&reader.done, __ATOMIC_ACQUIRE)) {
+    ecs_step(registry);
+  }
+  pthread_join(reader.thread, NULL);
+  ASSERT_EQ(reader.torn, 0);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+static ecs_spawner_t *spawn_spawner;
+
+void spawn_later(ecs_view_t view, uint32_t row) {
+  (void)view;
+  (void)row;
+  ecs_spawn(spawn_spawner);
+}
+
+void attach_now(ecs_view_t view, uint32_t row) {
+  (void)view;
+  (void)row;
+  ecs_attach(peek_registry, peek_entity, peek_component);
+}
+
+static void step_peek_registry(void) { ecs_step(peek_registry); }
+
+TEST ecs_structural_changes_wait_for_systems() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t tag_component = ecs_component(registry, sizeof(int));
+  ecs_component_buffered(registry, int_component);
+  for (int i = 0; i < 4; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, int_component);
+    ecs_set(registry, e, int_component, &(int){1});
+  }
+
+  // spawners hold new entities until the step is over
+  spawn_spawner = ecs_spawner(registry);
+  ecs_entity_t spawn = ECS_SYSTEM(registry, spawn_later, 1, int_component);
+  uint64_t epoch = ecs_epoch(registry);
+  ecs_step(registry);
+  ASSERT(ecs_epoch(registry) != epoch);
+  ecs_system_remove(registry, spawn);
+
+  // moving rows while front readers may be in aborts
+  peek_registry = registry;
+  peek_entity = ecs_entity(registry);
+  peek_component = tag_component;
+  ecs_attach(registry, peek_entity, int_component);
+  ECS_SYSTEM(registry, attach_now, 1, int_component);
+  ASSERT(aborts(step_peek_registry));
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+TEST ecs_shared_worlds() {
+  ecs_registry_t *base = ecs_init();
+  ecs_entity_t int_component = ecs_component(base, sizeof(int));
+
+  ecs_registry_t *worlds[8];
+  ecs_entity_t entities[8];
+  for (int i = 0; i < 8; i++) {
+    worlds[i] = ecs_init_shared(base);
+    entities[i] = ecs_entity(worlds[i]);
+    ecs_attach(worlds[i], entities[i], int_component);
+    ecs_set(worlds[i], entities[i], int_component, &(int){i});
+    ECS_SYSTEM(worlds[i], increment, 1, int_component);
+  }
+
+  // components defined later are visible everywhere under the same id
+  ecs_entity_t late_component = ecs_component(worlds[3], sizeof(int));
+  ecs_attach(worlds[5], entities[5], late_component);
+
+  // worlds only step their own entities, and ids never repeat across worlds
+  ecs_step(worlds[2]);
+  for (int i = 0; i < 8; i++) {
+    int expected = i == 2 ? 3 : i;
+    ASSERT_EQ(*(const int *)ecs_get(worlds[i], entities[i], int_component),
+              expected);
+    for (int j = 0; j < i; j++) {
+      ASSERT(entities[i] != entities[j]);
+    }
+  }
+
+  // definitions outlive the registry that made them
+  ecs_destroy(base);
+  ecs_step(worlds[7]);
+  ASSERT_EQ(*(const int *)ecs_get(worlds[7], entities[7], int_component), 8);
+  for (int i = 0; i < 8; i++) {
+    ecs_destroy(worlds[i]);
+  }
+  PASS();
+}
+
+TEST ecs_migrate_between_worlds() {
+  ecs_registry_t *from = ecs_init();
+  ecs_registry_t *to = ecs_init_shared(from);
+  ecs_entity_t int_component = ecs_component(from, sizeof(int));
+  ecs_entity_t tag_component = ecs_component(from, sizeof(int));
+
+  ecs_entity_t entities[100];
+  for (int i = 0; i < 100; i++) {
+    entities[i] = ecs_entity(from);
+    ecs_attach(from, entities[i], int_component);
+    ecs_set(from, entities[i], int_component, &(int){i});
+    if (i % 2 == 0) {
+      ecs_attach(from, entities[i], tag_component);
+    }
+  }
+
+  ecs_query_t *from_query =
+      ecs_query(from, ecs_signature_new_n(1, int_component));
+  ecs_query_t *to_query = ecs_query(to, ecs_signature_new_n(1, int_component));
+
+  // a scattered handful of entities keep their ids and values
+  ecs_entity_t moving[] = {entities[3], entities[4], entities[50],
+                           entities[99], entities[0]};
+  ecs_migrate(to, from, moving, 5);
+  ASSERT_EQ(*(const int *)ecs_get(to, entities[50], int_component), 50);
+  ASSERT_EQ(*(const int *)ecs_get(to, entities[3], int_component), 3);
+  ASSERT_EQ(ecs_get(to, entities[3], tag_component), NULL);
+  ASSERT(ecs_get(to, entities[4], tag_component) != NULL);
+
+  Stats stats = {0, 100, 0};
+  ecs_query_each(from, from_query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 4950 - (3 + 4 + 50 + 99 + 0));
+  for (int i = 1; i < 100; i++) {
+    if (i != 3 && i != 4 && i != 50 && i != 99) {
+      ASSERT_EQ(*(const int *)ecs_get(from, entities[i], int_component), i);
+    }
+  }
+
+  // everything else follows in bulk, archetype by archetype
+  ecs_migrate_matching(to, from, ecs_signature_new_n(1, int_component));
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(from, from_query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 0);
+  stats = (Stats){0, 100, 0};
+  ecs_query_each(to, to_query, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 4950);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(*(const int *)ecs_get(to, entities[i], int_component), i);
+    ASSERT_EQ(ecs_get(to, entities[i], tag_component) != NULL, i % 2 == 0);
+  }
+
+  ecs_query_free(from_query);
+  ecs_query_free(to_query);
+  ecs_destroy(from);
+  ecs_destroy(to);
+  PASS();
+}
+
+static int visit_log[64];
+static int visit_len = 0;
+
+void log_visit(ecs_view_t view, uint32_t row) {
+  visit_log[visit_len++] = *(int *)ecs_view(view, row, 0);
+}
+
+TEST ecs_deterministic_order() {
+  ecs_registry_t *a = ecs_init();
+  ecs_registry_t *b = ecs_init();
+  ecs_deterministic(a);
+  ecs_deterministic(b);
+
+  ecs_entity_t int_a = ecs_component(a, sizeof(int));
+  ecs_entity_t tag_a = ecs_component(a, sizeof(int));
+  ecs_entity_t int_b = ecs_component(b, sizeof(int));
+  ecs_entity_t tag_b = ecs_component(b, sizeof(int));
+  ASSERT_EQ(int_a, int_b);
+
+  // the same entities built up in a different order
+  for (int i = 0; i < 30; i++) {
+    ecs_entity_t e = ecs_entity(a);
+    ecs_attach(a, e, int_a);
+    ecs_set(a, e, int_a, &(int){i});
+    if (i % 3 == 0) {
+      ecs_attach(a, e, tag_a);
+      ecs_set(a, e, tag_a, &(int){0});
+    }
+  }
+
+  ecs_entity_t entities[30];
+  for (int i = 0; i < 30; i++) {
+    entities[i] = ecs_entity(b);
+  }
+  for (int i = 0; i < 30; i += 3) {
+    ecs_attach(b, entities[i], tag_b);
+    ecs_set(b, entities[i], tag_b, &(int){0});
+  }
+  for (int i = 29; i >= 0; i--) {
+    ecs_attach(b, entities[i], int_b);
+    ecs_set(b, entities[i], int_b, &(int){i});
+  }
+
+  ASSERT_EQ(ecs_world_hash(a), ecs_world_hash(b));
+
+  ECS_SYSTEM(a, log_visit, 1, int_a);
+  ECS_SYSTEM(b, log_visit, 1, int_b);
+  int log_a[30];
+  visit_len = 0;
+  ecs_step(a);
+  ASSERT_EQ(visit_len, 30);
+  memcpy(log_a, visit_log, sizeof(log_a));
+  visit_len = 0;
+  ecs_step(b);
+  ASSERT_EQ(visit_len, 30);
+  ASSERT_MEM_EQ(log_a, visit_log, sizeof(log_a));
+
+  // the hash follows component values
+  ecs_set(b, entities[7], int_b, &(int){100});
+  ASSERT(ecs_world_hash(a) != ecs_world_hash(b));
+
+  ecs_destroy(a);
+  ecs_destroy(b);
+  PASS();
+}
+
+TEST ecs_checksum_tracks_changes() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t int_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t tag_component = ecs_component(registry, sizeof(int));
+
+  ecs_entity_t entities[100];
+  for (int i = 0; i < 100; i++) {
+    entities[i] = ecs_entity(registry);
+    ecs_attach(registry, entities[i], int_component);
+    ecs_attach(registry, entities[i], tag_component);
+    ecs_set(registry, entities[i], int_component, &(int){i});
+    ecs_set(registry, entities[i], tag_component, &(int){0});
+  }
+
+  uint64_t all = ecs_checksum(registry, NULL, 0);
+  uint64_t tags = ecs_checksum(registry, &tag_component, 1);
+  ASSERT(all != tags);
+  ASSERT_EQ(ecs_checksum(registry, NULL, 0), all);
+
+  // ecs_set and systems are tracked
+  ecs_set(registry, entities[40], int_component, &(int){1000});
+  ASSERT(ecs_checksum(registry, NULL, 0) != all);
+  ASSERT_EQ(ecs_checksum(registry, &tag_component, 1), tags);
+  ecs_set(registry, entities[40], int_component, &(int){40});
+  ASSERT_EQ(ecs_checksum(registry, NULL, 0), all);
+
+  uint64_t tick = ecs_change_tick(registry);
+  ECS_SYSTEM(registry, increment, 1, int_component);
+  ecs_step(registry);
+  ASSERT(ecs_change_tick(registry) > tick);
+  uint64_t stepped = ecs_checksum(registry, NULL, 0);
+  ASSERT(stepped != all);
+  ASSERT_EQ(ecs_checksum(registry, &tag_component, 1), tags);
+
+  // query views may be written, so their columns are marked like a system's
+  ecs_query_t *query =
+      ecs_query(registry, ecs_signature_new_n(1, int_component));
+  ecs_query_each(registry, query, increment_each, NULL);
+  uint64_t queried = ecs_checksum(registry, NULL, 0);
+  ASSERT(queried != stepped);
+  ASSERT_EQ(ecs_checksum(registry, &tag_component, 1), tags);
+
+  // writes through pointers from ecs_get are only seen once reported
+  *(int *)ecs_get(registry, entities[3], int_component) += 1;
+  ASSERT_EQ(ecs_checksum(registry, NULL, 0), queried);
+  ecs_changed(registry, int_component);
+  ASSERT(ecs_checksum(registry, NULL, 0) != queried);
+
+  // columns that systems and walks only read keep their ticks, which an
+  // unreported write to one of them shows
+  uint64_t tag_tick = ecs_change_tick(registry);
+  *(int *)ecs_get(registry, entities[3], tag_component) = 9;
+  ECS_SYSTEM(registry, increment, 2, int_component, ECS_READ(tag_component));
+  ecs_step(registry);
+  ecs_query_t *reading = ecs_query(
+      registry, ecs_signature_new_n(1, ECS_READ(tag_component)));
+  Stats stats = {0, 100, 0};
+  ecs_query_each(registry, reading, gather_stats, &stats);
+  ASSERT_EQ(stats.total, 9);
+  ASSERT(ecs_change_tick(registry) > tag_tick);
+  ASSERT_EQ(ecs_checksum(registry, &tag_component, 1), tags);
+  ecs_changed(registry, tag_component);
+  ASSERT(ecs_checksum(registry, &tag_component, 1) != tags);
+  ecs_query_free(reading);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct Name {
+  char text[6];
+} Name;
+
+TEST ecs_delta_loopback() {
+  ecs_registry_t *server = ecs_init();
+  ecs_registry_t *client = ecs_init();
+  ecs_entity_t pos_component = ecs_component(server, sizeof(Vec2));
+  ecs_entity_t name_component = ecs_component(server, sizeof(Name));
+  ecs_entity_t int_component = ecs_component(server, sizeof(int));
+
+  // the client registers the same components in the same order
+  ASSERT_EQ(ecs_component(client, sizeof(Vec2)), pos_component);
+  ASSERT_EQ(ecs_component(client, sizeof(Name)), name_component);
+  ASSERT_EQ(ecs_component(client, sizeof(int)), int_component);
+
+  ecs_entity_t entities[50];
+  for (int i = 0; i < 50; i++) {
+    entities[i] = ecs_entity(server);
+    ecs_attach(server, entities[i], pos_component);
+    ecs_attach(server, entities[i], int_component);
+    ecs_set(server, entities[i], pos_component,
+            &(Vec2){(float)i, 2.0f * (float)i});
+    if (i % 5 == 0) {
+      ecs_attach(server, entities[i], name_component);
+      ecs_set(server, entities[i], name_component, &(Name){"abcde"});
+    }
+  }
+
+  ecs_entity_t replicated[] = {pos_component, name_component};
+  ecs_baseline_t *sent = ecs_baseline(server, replicated, 2);
+  ecs_baseline_t *received = ecs_baseline(client, replicated, 2);
+  unsigned char packet[2048];
+
+  // names are packed, and read where they are
+  ASSERT(ecs_compress_cold(server, 0) > 0);
+  size_t packed = ecs_cold_bytes(server);
+
+  // too small a buffer reports the size needed and sends nothing
+  size_t needed = ecs_delta_encode(server, sent, entities, 50, packet, 16);
+  ASSERT(needed > 16);
+  size_t full = ecs_delta_encode(server, sent, entities, 50, packet,
+                                 sizeof(packet));
+  ASSERT_EQ(full, needed);
+  ASSERT_EQ(ecs_cold_bytes(server), packed);
+  ASSERT(ecs_delta_decode(client, received, packet, full));
+
+  // a few small changes cost far less than the first snapshot
+  ecs_set(server, entities[7], pos_component, &(Vec2){7.5f, 14.0f});
+  ecs_set(server, entities[10], name_component, &(Name){"abcdf"});
+  size_t delta = ecs_delta_encode(server, sent, entities, 50, packet,
+                                  sizeof(packet));
+  ASSERT(delta * 10 < full);
+  ASSERT(ecs_delta_decode(client, received, packet, delta));
+
+  for (int i = 0; i < 50; i++) {
+    ecs_entity_t local = ecs_baseline_local(received, entities[i]);
+    ASSERT(local != 0);
+    ASSERT_MEM_EQ(ecs_get(server, entities[i], pos_component),
+                  ecs_get(client, local, pos_component), sizeof(Vec2));
+    if (i % 5 == 0) {
+      ASSERT_MEM_EQ(ecs_get(server, entities[i], name_component),
+                    ecs_get(client, local, name_component), sizeof(Name));
+    } else {
+      ASSERT_EQ(ecs_get(client, local, name_component), NULL);
+    }
+    ASSERT_EQ(ecs_get(client, local, int_component), NULL);
+  }
+
+  // bad input is refused without touching the client
+  ecs_set(server, entities[3], pos_component, &(Vec2){-1.0f, -1.0f});
+  delta = ecs_delta_encode(server, sent, entities, 50, packet, sizeof(packet));
+  ASSERT_FALSE(ecs_delta_decode(client, received, packet, delta - 1));
+  ASSERT_FALSE(ecs_delta_decode(client, received, (unsigned char[]){0xff},
+                                1)); // an id 127 bits long
+  ecs_entity_t third = ecs_baseline_local(received, entities[3]);
+  ASSERT_EQ(((const Vec2 *)ecs_get(client, third, pos_component))->x, 3.0f);
+  ASSERT(ecs_delta_decode(client, received, packet, delta));
+  ASSERT_EQ(((const Vec2 *)ecs_get(client, third, pos_component))->x, -1.0f);
+
+  // nothing changed, nothing to send
+  ASSERT_EQ(ecs_delta_encode(server, sent, entities, 50, packet,
+                             sizeof(packet)),
+            1);
+
+  ecs_baseline_free(sent);
+  ecs_baseline_free(received);
+  ecs_destroy(server);
+  ecs_destroy(client);
+  PASS();
+}
+
+static bool odd_value(ecs_view_t view, uint32_t row, void *ctx) {
+  (void)ctx;
+  return *(int *)ecs_view(view, row, 1) % 2 == 1;
+}
+
+// writes every row it visits, but only changes one value
+static void bump_seven(ecs_view_t view, unsigned int row) {
+  int *value = ecs_view(view, row, 1);
+  *value = *value == 7 ? 71 : *value;
+}
+
+TEST ecs_interest_per_observer() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t pos_component = ECS_COMPONENT(registry, Vec2);
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t name_component = ECS_COMPONENT(registry, Name);
+
+  // a 10x10 grid, and a few far away entities in another archetype
+  ecs_entity_t grid[100];
+  for (int i = 0; i < 100; i++) {
+    grid[i] = ecs_entity(registry);
+    ecs_attach(registry, grid[i], pos_component);
+    ecs_attach(registry, grid[i], int_component);
+    ecs_set(registry, grid[i], pos_component,
+            &(Vec2){(float)(i % 10), (float)(i / 10)});
+    ecs_set(registry, grid[i], int_component, &i);
+  }
+  for (int i = 0; i < 5; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, pos_component);
+    ecs_attach(registry, e, int_component);
+    ecs_attach(registry, e, name_component);
+    ecs_set(registry, e, pos_component, &(Vec2){100.0f, 100.0f + (float)i});
+    ecs_set(registry, e, int_component, &(int){0});
+  }
+
+  uint32_t near = 0;
+  for (int i = 0; i < 100; i++) {
+    int x = i % 10, y = i / 10;
+    near += x * x + y * y <= 6;
+  }
+
+  ecs_interest_t *interest =
+      ecs_interest(registry,
+                   ecs_signature_new_n(2, pos_component, int_component),
+                   pos_component);
+  uint32_t spatial = ecs_interest_observer(interest);
+  uint32_t filtered = ecs_interest_observer(interest);
+  ecs_interest_radius(interest, spatial, 0.0f, 0.0f, 2.5f);
+  ecs_interest_filter(interest, filtered, odd_value, NULL);
+
+  ecs_entity_t out[128];
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), near);
+  ASSERT_EQ(out[0], grid[0]);
+  ASSERT_EQ(ecs_interest_collect(interest, filtered, out, 128), 50);
+  ASSERT_EQ(out[0], grid[1]);
+
+  // nothing changed since the last collect
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 0);
+  ASSERT_EQ(ecs_interest_collect(interest, filtered, out, 128), 0);
+
+  // only the written row is returned, to each observer that finds it relevant
+  ecs_set(registry, grid[11], pos_component, &(Vec2){1.5f, 1.5f});
+  ecs_set(registry, grid[3], pos_component, &(Vec2){3.0f, 0.0f});
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 0), 1);
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 1);
+  ASSERT_EQ(out[0], grid[11]);
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 0);
+  ASSERT_EQ(ecs_interest_collect(interest, filtered, out, 128), 1);
+  ASSERT_EQ(out[0], grid[11]);
+
+  // a system touches every row of its columns but changed only one of them
+  ecs_system(registry, ecs_signature_new_n(2, pos_component, int_component),
+             bump_seven);
+  ecs_step(registry);
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 0);
+  ASSERT_EQ(ecs_interest_collect(interest, filtered, out, 128), 1);
+  ASSERT_EQ(out[0], grid[7]);
+  ecs_step(registry);
+  ASSERT_EQ(ecs_interest_collect(interest, filtered, out, 128), 0);
+
+  // moving an entity out puts another in its row, which counts as a change
+  ecs_attach(registry, grid[0], name_component);
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 1);
+  ASSERT_EQ(out[0], grid[0]);
+  ASSERT_EQ(ecs_interest_collect(interest, filtered, out, 128), 1);
+  ASSERT_EQ(out[0], grid[99]);
+
+  // moving the observer rescans, and the grid is culled by its bounds
+  ecs_interest_radius(interest, spatial, 100.0f, 100.0f, 1.5f);
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 2);
+  ASSERT_EQ(ecs_interest_collect(interest, spatial, out, 128), 0);
+
+  ecs_interest_free(interest);
+  ecs_destroy(registry);
+  PASS();
+}
+
+TEST ecs_interest_left_relevancy() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t pos_component = ECS_COMPONENT(registry, Vec2);
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_rollback_t *rollback = ecs_rollback(registry, 4);
+
+  // a row of entities along x, of which the first two are in range
+  ecs_entity_t row[5];
+  for (int i = 0; i < 5; i++) {
+    row[i] = ecs_entity(registry);
+    ecs_attach(registry, row[i], pos_component);
+    ecs_set(registry, row[i], pos_component, &(Vec2){(float)i, 0.0f});
+  }
+  ecs_rollback_save(rollback, 0);
+
+  ecs_interest_t *interest = ecs_interest(
+      registry, ecs_signature_new_n(1, pos_component), pos_component);
+  uint32_t observer = ecs_interest_observer(interest);
+  ecs_interest_radius(interest, observer, 0.0f, 0.0f, 1.5f);
+
+  ecs_entity_t out[8];
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 2);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 8), 0);
+
+  // walking out of range is reported once, and only when it fits
+  ecs_set(registry, row[1], pos_component, &(Vec2){3.0f, 0.0f});
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 0);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 0), 1);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 8), 1);
+  ASSERT_EQ(out[0], row[1]);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 8), 0);
+
+  // coming back before the client heard it left only sends it again
+  ecs_set(registry, row[1], pos_component, &(Vec2){1.0f, 0.0f});
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 1);
+  ecs_set(registry, row[1], pos_component, &(Vec2){4.0f, 0.0f});
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 0);
+  ecs_set(registry, row[1], pos_component, &(Vec2){1.0f, 0.0f});
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 1);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 8), 0);
+
+  // an entity of a newer archetype, taken away again by a rollback
+  ecs_entity_t late = ecs_entity(registry);
+  ecs_attach(registry, late, pos_component);
+  ecs_attach(registry, late, int_component);
+  ecs_set(registry, late, pos_component, &(Vec2){0.5f, 0.0f});
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 1);
+  ASSERT_EQ(out[0], late);
+  ASSERT(ecs_rollback_restore(rollback, 0));
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 0);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 8), 1);
+  ASSERT_EQ(out[0], late);
+
+  // the whole archetype moving away is culled by its bounds without visiting a
+  // row, and everything in range leaves with it
+  for (int i = 0; i < 5; i++) {
+    ecs_set(registry, row[i], pos_component, &(Vec2){(float)i, 50.0f});
+  }
+  ASSERT_EQ(ecs_interest_collect(interest, observer, out, 8), 0);
+  ASSERT_EQ(ecs_interest_left(interest, observer, out, 8), 2);
+  ASSERT((out[0] == row[0] && out[1] == row[1]) ||
+         (out[0] == row[1] && out[1] == row[0]));
+
+  ecs_interest_free(interest);
+  ecs_rollback_free(rollback);
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct {
+  ecs_entity_t int_component;
+  ecs_entity_t flag_component;
+} Inputs;
+
+// a late joiner arrives at tick 3 in an archetype nobody had yet
+static void spawn_on_tick_3(ecs_registry_t *registry, uint64_t tick,
+                            void *ctx) {
+  Inputs *inputs = ctx;
+  if (tick == 3) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, inputs->int_component);
+    ecs_attach(registry, e, inputs->flag_component);
+    ecs_set(registry, e, inputs->int_component, &(int){100});
+  }
+}
+
+TEST ecs_rollback_resimulate() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_deterministic(registry);
+  Inputs inputs = {ecs_component(registry, sizeof(int)),
+                   ecs_component(registry, sizeof(int))};
+  ecs_entity_t still_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t timed_component = ecs_component(registry, sizeof(int));
+
+  for (int i = 0; i < 100; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, inputs.int_component);
+    ecs_attach(registry, e, still_component);
+    ecs_attach(registry, e, timed_component);
+    ecs_set(registry, e, inputs.int_component, &i);
+    ecs_set(registry, e, still_component, &i);
+    ecs_set(registry, e, timed_component, &i);
+  }
+  ECS_SYSTEM(registry, increment, 1, inputs.int_component);
+
+  // systems whose timing and position carry over between steps
+  ecs_entity_t fixed = ECS_SYSTEM(registry, increment, 1, timed_component);
+  ecs_system_fixed(registry, fixed, 1.0f, 0.0f);
+  ecs_entity_t strided = ECS_SYSTEM(registry, increment, 1, timed_component);
+  ecs_system_stride(registry, strided, 3);
+
+  ecs_rollback_t *rollback = ecs_rollback(registry, 8);
+  uint64_t hashes[10];
+  for (uint64_t tick = 0; tick < 10; tick++) {
+    ecs_rollback_save(rollback, tick);
+    hashes[tick] = ecs_world_hash(registry);
+    spawn_on_tick_3(registry, tick, &inputs);
+    ecs_step_delta(registry, 0.375f);
+  }
+  uint64_t final = ecs_world_hash(registry);
+
+  // only the last eight ticks are kept
+  ASSERT_FALSE(ecs_rollback_restore(rollback, 1));
+  ASSERT(ecs_rollback_restore(rollback, 7));
+  ASSERT_EQ(ecs_world_hash(registry), hashes[7]);
+  ASSERT(ecs_rollback_restore(rollback, 9));
+  ASSERT_EQ(ecs_world_hash(registry), hashes[9]);
+
+  // back to before the late joiner, which is created again with the same id
+  ASSERT(ecs_rollback_restore(rollback, 2));
+  ASSERT_EQ(ecs_world_hash(registry), hashes[2]);
+  ASSERT(ecs_resimulate(rollback, 2, 10, 0.375f, spawn_on_tick_3, &inputs));
+  ASSERT_EQ(ecs_world_hash(registry), final);
+  ASSERT(ecs_rollback_restore(rollback, 5));
+  ASSERT_EQ(ecs_world_hash(registry), hashes[5]);
+
+  ecs_rollback_free(rollback);
+  ecs_destroy(registry);
+  PASS();
+}
+
+void drift(ecs_view_t view, uint32_t row) {
+  Vec2 *p = ecs_view(view, row, 0);
+  p->x += 3.0f;
+}
+
+// compares a spatial query against every entity in the list
+static bool spatial_agrees(ecs_registry_t *registry, ecs_spatial_t *spatial,
+                           ecs_entity_t pos_component,
+                           const ecs_entity_t *entities, uint32_t count,
+                           float x, float y, float radius) {
+  ecs_entity_t found[512];
+  uint32_t total = ecs_spatial_radius(spatial, x, y, radius, found, 512);
+  uint32_t expected = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const Vec2 *p = ecs_get(registry, entities[i], pos_component);
+    float dx = p->x - x, dy = p->y - y;
+    if (dx * dx + dy * dy > radius * radius) {
+      continue;
+    }
+    expected++;
+
+    bool listed = false;
+    for (uint32_t j = 0; j < total && j < 512; j++) {
+      listed = listed || found[j] == entities[i];
+    }
+    if (!listed) {
+      return false;
+    }
+  }
+  return total == expected;
+}
+
+TEST ecs_spatial_queries() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t pos_component = ECS_COMPONENT(registry, Vec2);
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+
+  ecs_entity_t entities[400];
+  uint32_t seed = 12345;
+  for (int i = 0; i < 400; i++) {
+    entities[i] = ecs_entity(registry);
+    ecs_attach(registry, entities[i], pos_component);
+    seed = seed * 1664525u + 1013904223u;
+    float x = (float)(seed >> 16) / 65536.0f * 200.0f - 100.0f;
+    seed = seed * 1664525u + 1013904223u;
+    float y = (float)(seed >> 16) / 65536.0f * 200.0f - 100.0f;
+    ecs_set(registry, entities[i], pos_component, &(Vec2){x, y});
+  }
+
+  ecs_spatial_t *spatial = ecs_spatial(registry, pos_component, 10.0f);
+  ASSERT(spatial_agrees(registry, spatial, pos_component, entities, 400,
+                        0.0f, 0.0f, 25.0f));
+  ASSERT(spatial_agrees(registry, spatial, pos_component, entities, 400,
+                        -95.0f, 40.0f, 12.5f));
+  ASSERT(spatial_agrees(registry, spatial, pos_component, entities, 400,
+                        0.0f, 0.0f, 1000.0f));
+
+  ecs_entity_t found[8];
+  ASSERT_EQ(ecs_spatial_aabb(spatial, -100.0f, -100.0f, 100.0f, 100.0f,
+                             found, 8),
+            400);
+  ASSERT_EQ(ecs_spatial_aabb(spatial, 500.0f, 500.0f, 600.0f, 600.0f,
+                             found, 8),
+            0);
+
+  // writes, systems and archetype changes are picked up before each query
+  ecs_set(registry, entities[0], pos_component, &(Vec2){550.0f, 550.0f});
+  ASSERT_EQ(ecs_spatial_aabb(spatial, 500.0f, 500.0f, 600.0f, 600.0f,
+                             found, 8),
+            1);
+  ASSERT_EQ(found[0], entities[0]);
+
+  ECS_SYSTEM(registry, drift, 1, pos_component);
+  ecs_step(registry);
+  for (int i = 0; i < 400; i += 3) {
+    ecs_attach(registry, entities[i], int_component);
+  }
+  ASSERT(spatial_agrees(registry, spatial, pos_component, entities, 400,
+                        3.0f, 0.0f, 25.0f));
+  ASSERT(spatial_agrees(registry, spatial, pos_component, entities, 400,
+                        50.0f, -50.0f, 40.0f));
+
+  // entities that disappear, here by rolling back, leave the index
+  ecs_rollback_t *rollback = ecs_rollback(registry, 1);
+  ecs_rollback_save(rollback, 0);
+  for (int i = 0; i < 5; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, pos_component);
+    ecs_set(registry, e, pos_component, &(Vec2){-550.0f, -550.0f});
+  }
+  ASSERT_EQ(ecs_spatial_radius(spatial, -550.0f, -550.0f, 1.0f, found, 8), 5);
+  ASSERT(ecs_rollback_restore(rollback, 0));
+  ASSERT_EQ(ecs_spatial_radius(spatial, -550.0f, -550.0f, 1.0f, found, 8), 0);
+  ASSERT_EQ(ecs_spatial_radius(spatial, 0.0f, 0.0f, 1000.0f, found, 8), 400);
+
+  // coordinates beyond the cell range land in the outermost cells
+  ecs_set(registry, entities[1], pos_component, &(Vec2){3e38f, -3e38f});
+  ASSERT_EQ(ecs_spatial_aabb(spatial, 1e38f, -3.4e38f, 3.4e38f, -1e38f, found,
+                             8),
+            1);
+  ASSERT_EQ(found[0], entities[1]);
+  ASSERT_EQ(ecs_spatial_radius(spatial, 0.0f, 0.0f, 1000.0f, found, 8), 399);
+
+  ecs_rollback_free(rollback);
+  ecs_spatial_free(spatial);
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct {
+  uint32_t id;
+  int16_t team;
+  float score;
+} Player;
+
+void renumber(ecs_view_t view, uint32_t row) {
+  Player *player = ecs_view(view, row, 0);
+  player->id += 1000;
+}
+
+TEST ecs_secondary_indices() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t player_component = ECS_COMPONENT(registry, Player);
+  ecs_entity_t int_component = ECS_COMPONENT(registry, int);
+  ecs_entity_t split_component = ECS_COMPONENT(registry, Player);
+  ECS_COMPONENT_SPLIT(registry, split_component, 3, ECS_FIELD(Player, id),
+                      ECS_FIELD(Player, team), ECS_FIELD(Player, score));
+
+  ecs_entity_t players[200];
+  for (int i = 0; i < 200; i++) {
+    Player player = {1000 + i, (int16_t)(i % 7 - 3), (float)(i - 100) * 0.5f};
+    players[i] = ecs_entity(registry);
+    ecs_attach(registry, players[i], player_component);
+    ecs_attach(registry, players[i], split_component);
+    ecs_set(registry, players[i], player_component, &player);
+    ecs_set(registry, players[i], split_component, &player);
+  }
+
+  ecs_index_t *by_id = ecs_index_hash(registry, player_component,
+                                      ECS_KEY_FIELD(Player, id),
+                                      ECS_KEY_UNSIGNED);
+  ecs_index_t *by_team = ecs_index_hash(registry, player_component,
+                                        ECS_KEY_FIELD(Player, team),
+                                        ECS_KEY_SIGNED);
+  ecs_index_t *by_score = ecs_index_sorted(registry, player_component,
+                                           ECS_KEY_FIELD(Player, score),
+                                           ECS_KEY_FLOAT);
+  ecs_index_t *split_team = ecs_index_sorted(registry, split_component,
+                                             ECS_KEY_FIELD(Player, team),
+                                             ECS_KEY_SIGNED);
+
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){1042}), players[42]);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){9999}), 0);
+
+  ecs_entity_t found[64];
+  ASSERT_EQ(ecs_index_find_all(by_team, &(int16_t){-3}, found, 64), 29);
+  ASSERT_EQ(ecs_index_find_all(split_team, &(int16_t){-3}, found, 64), 29);
+  ASSERT_EQ(found[0], players[0]);
+  ASSERT_EQ(ecs_index_range(split_team, &(int16_t){-3}, &(int16_t){-2}, found,
+                            64),
+            58);
+
+  // ranges come back in value order, negative floats first
+  ASSERT_EQ(ecs_index_range(by_score, &(float){-5.0f}, &(float){5.0f}, found,
+                            64),
+            21);
+  for (int i = 0; i < 21; i++) {
+    ASSERT_EQ(found[i], players[90 + i]);
+  }
+
+  // ecs_set keeps the index current
+  Player moved = {7, 0, 1000.0f};
+  ecs_set(registry, players[42], player_component, &moved);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){1042}), 0);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){7}), players[42]);
+  ASSERT_EQ(ecs_index_range(by_score, &(float){999.0f}, &(float){1001.0f},
+                            found, 64),
+            1);
+
+  // an entity that changes key and back between lookups is found once
+  ecs_set(registry, players[42], player_component, &(Player){7, 0, 3.0f});
+  ecs_set(registry, players[42], player_component, &moved);
+  ASSERT_EQ(ecs_index_range(by_score, &(float){999.0f}, &(float){1001.0f},
+                            found, 64),
+            1);
+
+  // both zeros are the same key
+  ecs_set(registry, players[101], player_component,
+          &(Player){1101, 1, -0.0f});
+  ASSERT_EQ(ecs_index_find_all(by_score, &(float){0.0f}, found, 64), 2);
+  ASSERT_EQ(ecs_index_find_all(by_score, &(float){-0.0f}, found, 64), 2);
+
+  // so do archetype moves, and writes by systems are found by change ticks
+  for (int i = 0; i < 200; i += 2) {
+    ecs_attach(registry, players[i], int_component);
+  }
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){1043}), players[43]);
+  ECS_SYSTEM(registry, renumber, 1, player_component);
+  ecs_step(registry);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){1043}), 0);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){2043}), players[43]);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){2044}), players[44]);
+
+  // entities that disappear, here by rolling back, leave the index
+  ecs_rollback_t *rollback = ecs_rollback(registry, 1);
+  ecs_rollback_save(rollback, 0);
+  ecs_entity_t late = ecs_entity(registry);
+  ecs_attach(registry, late, player_component);
+  ecs_set(registry, late, player_component, &(Player){5, 0, 0.0f});
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){5}), late);
+  ASSERT(ecs_rollback_restore(rollback, 0));
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){5}), 0);
+  ASSERT_EQ(ecs_index_find(by_id, &(uint32_t){2044}), players[44]);
+  ecs_rollback_free(rollback);
+
+  ecs_index_free(by_id);
+  ecs_index_free(by_team);
+  // by_score and split_team are freed with the registry
+  ecs_destroy(registry);
+  PASS();
+}
+
+static int compare_float(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+typedef struct {
+  float last;
+  uint32_t rows;
+  bool ordered;
+} Merged;
+
+void check_merged(ecs_view_t view, uint32_t count, void *ctx) {
+  Merged *merged = ctx;
+  const float *depth = ecs_view_column(view, 0);
+  for (uint32_t i = 0; i < count; i++) {
+    merged->ordered = merged->ordered && depth[i] >= merged->last;
+    merged->last = depth[i];
+  }
+  merged->rows += count;
+}
+
+void check_ascending(ecs_view_t view, uint32_t count, void *ctx) {
+  bool *ascending = ctx;
+  const int *id = ecs_view_column(view, 0);
+  for (uint32_t i = 1; i < count; i++) {
+    *ascending = *ascending && id[i - 1] < id[i];
+  }
+}
+
+TEST ecs_sorted_rows() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t depth_component = ecs_component(registry, sizeof(float));
+  ecs_entity_t id_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t tag_component = ecs_component(registry, sizeof(int));
+
+  ecs_entity_t entities[300];
+  uint32_t seed = 99;
+  for (int i = 0; i < 300; i++) {
+    entities[i] = ecs_entity(registry);
+    ecs_attach(registry, entities[i], depth_component);
+    ecs_attach(registry, entities[i], id_component);
+    if (i % 3 == 0) {
+      ecs_attach(registry, entities[i], tag_component);
+    }
+    seed = seed * 1664525u + 1013904223u;
+    float depth = (float)(seed >> 8) / 65536.0f - 128.0f;
+    ecs_set(registry, entities[i], depth_component, &depth);
+    ecs_set(registry, entities[i], id_component, &i);
+  }
+
+  ecs_query_t *query = ecs_query(
+      registry, ecs_signature_new_n(2, depth_component, id_component));
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 0) {
+      ecs_sort(registry, depth_component, compare_float);
+    } else {
+      ecs_sort_by_key(registry, depth_component, 0, sizeof(float),
+                      ECS_KEY_FLOAT);
+    }
+
+    // rows moved, and every entity still finds its own values
+    for (int i = 0; i < 300; i++) {
+      ASSERT_EQ(*(const int *)ecs_get(registry, entities[i], id_component), i);
+    }
+
+    Merged merged = {-1000.0f, 0, true};
+    ecs_query_each_sorted(registry, query, 0, compare_float, check_merged,
+                          &merged);
+    ASSERT(merged.ordered);
+    ASSERT_EQ(merged.rows, 300);
+
+    for (int i = 0; i < 300; i++) {
+      float depth = (float)((i * 7919) % 300) - 150.0f;
+      ecs_set(registry, entities[i], depth_component, &depth);
+    }
+  }
+
+  // signed integer keys, largest id first
+  for (int i = 0; i < 300; i++) {
+    ecs_set(registry, entities[i], id_component, &(int){-i});
+  }
+  ecs_sort_by_key(registry, id_component, 0, sizeof(int), ECS_KEY_SIGNED);
+  for (int i = 0; i < 300; i++) {
+    ASSERT_EQ(*(const int *)ecs_get(registry, entities[i], id_component), -i);
+  }
+  bool ascending = true;
+  ecs_query_t *ids = ecs_query(registry, ecs_signature_new_n(1, id_component));
+  ecs_query_each(registry, ids, check_ascending, &ascending);
+  ASSERT(ascending);
+  ecs_query_free(ids);
+
+  ecs_query_free(query);
+  ecs_destroy(registry);
+  PASS();
+}
+
+typedef struct {
+  uint32_t calls;
+  uint32_t rows;
+  uint32_t unaligned;
+} Runs;
+
+void integrate_run(ecs_view_t view, uint32_t count, void *ctx) {
+  Runs *runs = ctx;
+  float *x = ecs_view_column(view, 0);
+  const float *dx = ecs_view_column(view, 1);
+  for (uint32_t i = 0; i < count; i++) {
+    x[i] += dx[i];
+  }
+  runs->calls++;
+  runs->rows += count;
+  runs->unaligned += (uintptr_t)x % 64 != 0 || (uintptr_t)dx % 64 != 0;
+}
+
+TEST ecs_owning_group() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t x_component = ecs_component(registry, sizeof(float));
+  ecs_entity_t dx_component = ecs_component(registry, sizeof(float));
+  ecs_entity_t tags[3];
+  for (int t = 0; t < 3; t++) {
+    tags[t] = ecs_component(registry, sizeof(int));
+  }
+
+  // entities spread over eight archetypes, some made after the group
+  ecs_entity_t entities[400];
+  ecs_group_t *group = NULL;
+  for (int i = 0; i < 400; i++) {
+    if (i == 100) {
+      group = ecs_group(registry,
+                        ecs_signature_new_n(2, x_component, dx_component));
+    }
+    entities[i] = ecs_entity(registry);
+    for (int t = 0; t < 3; t++) {
+      if (i & (1 << t)) {
+        ecs_attach(registry, entities[i], tags[t]);
+      }
+    }
+    ecs_attach(registry, entities[i], x_component);
+    ecs_attach(registry, entities[i], dx_component);
+    ecs_set(registry, entities[i], x_component, &(float){(float)i});
+    ecs_set(registry, entities[i], dx_component, &(float){1.0f});
+  }
+
+  Runs runs = {0, 0, 0};
+  ecs_group_each(group, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 400);
+  for (int i = 0; i < 400; i++) {
+    ASSERT_EQ(*(const float *)ecs_get(registry, entities[i], x_component),
+              (float)i + 1.0f);
+  }
+
+  // compacted, segments sit back to back but each starts on a cache line,
+  // so these 50 row archetypes are a run each
+  ecs_group_compact(group);
+  runs = (Runs){0, 0, 0};
+  ecs_group_each(group, integrate_run, &runs);
+  ASSERT_EQ(runs.calls, 8);
+  ASSERT_EQ(runs.rows, 400);
+  ASSERT_EQ(runs.unaligned, 0);
+
+  // archetypes keep growing, shrinking and being queried as usual
+  for (int i = 0; i < 400; i += 4) {
+    ecs_attach(registry, entities[i], tags[(i / 4) % 2]);
+  }
+  ecs_entity_t extra = ecs_entity(registry);
+  ecs_attach(registry, extra, x_component);
+  ecs_attach(registry, extra, dx_component);
+  ecs_set(registry, extra, x_component, &(float){-1.0f});
+  ecs_set(registry, extra, dx_component, &(float){1.0f});
+  ecs_query_t *query = ecs_query(
+      registry, ecs_signature_new_n(2, x_component, dx_component));
+  runs = (Runs){0, 0, 0};
+  ecs_query_each(registry, query, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 401);
+  runs = (Runs){0, 0, 0};
+  ecs_group_each(group, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 401);
+  ASSERT_EQ(runs.unaligned, 0);
+  ecs_group_compact(group);
+  runs = (Runs){0, 0, 0};
+  ecs_group_each(group, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 401);
+  ASSERT_EQ(runs.unaligned, 0);
+  ASSERT_EQ(*(const float *)ecs_get(registry, extra, x_component), 2.0f);
+  for (int i = 0; i < 400; i++) {
+    ASSERT_EQ(*(const float *)ecs_get(registry, entities[i], x_component),
+              (float)i + 5.0f);
+  }
+
+  // freeing the group hands the columns back
+  ecs_group_free(group);
+  ecs_attach(registry, extra, tags[0]);
+  runs = (Runs){0, 0, 0};
+  ecs_query_each(registry, query, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 401);
+  ASSERT_EQ(*(const float *)ecs_get(registry, entities[7], x_component), 13.0f);
+  ecs_query_free(query);
+
+  // left for the registry to free
+  ecs_group(registry, ecs_signature_new_n(1, tags[2]));
+  ecs_destroy(registry);
+  PASS();
+}
+
+TEST ecs_overlapping_groups() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t components[4];
+  for (int c = 0; c < 4; c++) {
+    components[c] = ecs_component(registry, sizeof(float));
+  }
+
+  // 100 entities with the first pair, 100 with the second, 50 with both
+  ecs_entity_t entities[250];
+  for (int i = 0; i < 250; i++) {
+    entities[i] = ecs_entity(registry);
+    for (int c = 0; c < 4; c++) {
+      if ((c < 2 && (i < 100 || i >= 200)) || (c >= 2 && i >= 100)) {
+        ecs_attach(registry, entities[i], components[c]);
+        ecs_set(registry, entities[i], components[c], &(float){1.0f});
+      }
+    }
+  }
+
+  // the shared archetype belongs to the first group, the second visits it
+  ecs_group_t *first = ecs_group(
+      registry, ecs_signature_new_n(2, components[0], components[1]));
+  ecs_group_t *second = ecs_group(
+      registry, ecs_signature_new_n(2, components[2], components[3]));
+  Runs runs = {0, 0, 0};
+  ecs_group_each(first, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 150);
+  runs = (Runs){0, 0, 0};
+  ecs_group_each(second, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 150);
+  ASSERT_EQ(runs.calls, 2);
+
+  ecs_group_compact(first);
+  ecs_group_compact(second);
+  runs = (Runs){0, 0, 0};
+  ecs_group_each(second, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 150);
+  ASSERT_EQ(*(const float *)ecs_get(registry, entities[220], components[0]),
+            2.0f);
+  ASSERT_EQ(*(const float *)ecs_get(registry, entities[220], components[2]),
+            3.0f);
+
+  // freeing the owner leaves the archetype with the other group as a guest
+  ecs_group_free(first);
+  runs = (Runs){0, 0, 0};
+  ecs_group_each(second, integrate_run, &runs);
+  ASSERT_EQ(runs.rows, 150);
+  ASSERT_EQ(*(const float *)ecs_get(registry, entities[220], components[2]),
+            4.0f);
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+TEST ecs_cold_columns() {
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t pos_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t vel_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t health_component = ecs_component(registry, sizeof(int));
+  ecs_entity_t name_component = ecs_component(registry, sizeof(int));
+
+  ecs_entity_t entities[1000];
+  for (int i = 0; i < 1000; i++) {
+    entities[i] = ecs_entity(registry);
+    ecs_attach(registry, entities[i], pos_component);
+    ecs_attach(registry, entities[i], vel_component);
+    ecs_attach(registry, entities[i], health_component);
+    ecs_attach(registry, entities[i], name_component);
+    ecs_set(registry, entities[i], pos_component, &i);
+    ecs_set(registry, entities[i], vel_component, &(int){1});
+    ecs_set(registry, entities[i], health_component, &(int){100});
+    ecs_set(registry, entities[i], name_component, &(int){i / 10});
+  }
+  ECS_SYSTEM(registry, move, 2, pos_component, vel_component);
+  ecs_step(registry);
+  ecs_step(registry);
+  ASSERT_EQ(ecs_accesses(registry, pos_component), 2000);
+  ASSERT_EQ(ecs_accesses(registry, health_component), 0);
+
+  // health is one run and names are runs of ten. the six columns of the empty
+  // archetypes passed through on the way pack to nothing.
+  ASSERT_EQ(ecs_compress_cold(registry, 0), 8);
+  ASSERT_EQ(ecs_accesses(registry, pos_component), 0);
+  size_t run = sizeof(uint32_t) + sizeof(int);
+  ASSERT_EQ(ecs_cold_bytes(registry), run + 100 * run);
+
+  // hot iteration leaves them packed
+  ecs_step(registry);
+  ASSERT_EQ(ecs_cold_bytes(registry), run + 100 * run);
+  ASSERT_EQ(*(const int *)ecs_get(registry, entities[5], pos_component), 8);
+
+  // anything else unpacks what it touches
+  ASSERT_EQ(*(const int *)ecs_get(registry, entities[5], health_component),
+            100);
+  ASSERT_EQ(ecs_cold_bytes(registry), 100 * run);
+  ecs_attach(registry, entities[3], ecs_component(registry, sizeof(int)));
+  ASSERT_EQ(ecs_cold_bytes(registry), 0);
+  ASSERT_EQ(*(const int *)ecs_get(registry, entities[999], name_component),
+            99);
+  ASSERT_EQ(*(const int *)ecs_get(registry, entities[3], name_component), 0);
+
+  // packing changes nothing that can be seen, and hashes and snapshots read
+  // packed columns where they are
+  uint64_t hash = ecs_world_hash(registry);
+  ASSERT(ecs_compress_cold(registry, 0) > 0);
+  size_t packed = ecs_cold_bytes(registry);
+  ASSERT(packed > 0);
+  ASSERT_EQ(ecs_world_hash(registry), hash);
+  ecs_checksum(registry, NULL, 0);
+  ecs_rollback_t *rollback = ecs_rollback(registry, 1);
+  ecs_rollback_save(rollback, 0);
+  ASSERT_EQ(ecs_cold_bytes(registry), packed);
+
+  // restoring unpacks only the columns written since
+  ecs_set(registry, entities[7], pos_component, &(int){-1});
+  ASSERT(ecs_rollback_restore(rollback, 0));
+  ASSERT_EQ(ecs_world_hash(registry), hash);
+  ASSERT(ecs_cold_bytes(registry) > 0);
+  ecs_rollback_free(rollback);
+  ASSERT(ecs_compress_cold(registry, 0) > 0);
+  ecs_inflate(registry);
+  ecs_read_begin(registry);
+  ASSERT_EQ(*(const int *)ecs_get(registry, entities[42], name_component), 4);
+  ecs_read_end(registry);
+
+  // only rows a run visits count, here 300 rows of a slice and every fourth
+  // row of the 999 and 1 row archetypes
+  ecs_entity_t sliced = ECS_SYSTEM(registry, increment, 1, health_component);
+  ecs_system_budget(registry, sliced, 300, 0);
+  ecs_entity_t strided = ECS_SYSTEM(registry, increment, 1, name_component);
+  ecs_system_stride(registry, strided, 4);
+  ecs_step(registry);
+  ASSERT_EQ(ecs_accesses(registry, health_component), 300);
+  ASSERT_EQ(ecs_accesses(registry, name_component), 250 + 1);
+
+  ecs_destroy(registry);
+  PASS();
+}
+
+SUITE(ecs) {
+  RUN_TEST(ecs_run_system_loop);
+  RUN_TEST(ecs_run_system);
+  RUN_TEST(ecs_minimal);
+  RUN_TEST(ecs_register);
+  RUN_TEST(ecs_create_entity);
+  RUN_TEST(ecs_attach_component);
+  RUN_TEST(ecs_set_component_data);
+  RUN_TEST1(ecs_from_bench, ((int[2]){10, 1000}));
+  RUN_TEST(ecs_split_component);
+  RUN_TEST(ecs_split_buffered_rollback);
+  RUN_TEST(ecs_system_matches_every_archetype);
+  RUN_TEST(ecs_chunk_system);
+  RUN_TEST(ecs_typed_system);
+  RUN_TEST(ecs_query_each_archetype);
+  RUN_TEST(ecs_system_timing);
+  RUN_TEST(ecs_system_order);
+  RUN_TEST(ecs_system_toggle_and_remove);
+  RUN_TEST(ecs_system_time_sliced);
+  RUN_TEST(ecs_system_strided);
+  RUN_TEST(ecs_system_parallel_ranges);
+  RUN_TEST(ecs_spawn_from_threads);
+  RUN_TEST(ecs_read_phase);
+  RUN_TEST(ecs_double_buffered_component);
+  RUN_TEST(ecs_structural_changes_wait_for_systems);
+  RUN_TEST(ecs_shared_worlds);
+  RUN_TEST(ecs_migrate_between_worlds);
+  RUN_TEST(ecs_deterministic_order);
+  RUN_TEST(ecs_checksum_tracks_changes);
+  RUN_TEST(ecs_delta_loopback);
+  RUN_TEST(ecs_interest_per_observer);
+  RUN_TEST(ecs_interest_left_relevancy);
+  RUN_TEST(ecs_rollback_resimulate);
+  RUN_TEST(ecs_spatial_queries);
+  RUN_TEST(ecs_secondary_indices);
+  RUN_TEST(ecs_sorted_rows);
+  RUN_TEST(ecs_owning_group);
+  RUN_TEST(ecs_overlapping_groups);
+  RUN_TEST(ecs_cold_columns);
+}
+
+TEST kernel_matches_scalar(ecs_simd_t simd) {
+  if (ecs_kernel_select(simd) != simd) {
+    SKIPm("instruction set not supported");
+  }
+
+  enum { N = 37 };
+  float x[N], y[N], want[N];
+  for (int i = 0; i < N; i++) {
+    x[i] = (float)i * 0.25f - 3.0f;
+    y[i] = (float)(N - i) * 0.5f;
+  }
+
+  memcpy(want, y, sizeof(want));
+  for (int i = 0; i < N; i++) {
+    want[i] += 1.5f * x[i];
+  }
+  ecs_kernel_axpy(y, x, 1.5f, N);
+  ASSERT_MEM_EQ(want, y, sizeof(want));
+
+  for (int i = 0; i < N; i++) {
+    want[i] *= -2.0f;
+  }
+  ecs_kernel_scale(y, -2.0f, N);
+  ASSERT_MEM_EQ(want, y, sizeof(want));
+
+  for (int i = 0; i < N; i++) {
+    want[i] = want[i] < -10.0f ? -10.0f : want[i] > 5.0f ? 5.0f : want[i];
+  }
+  ecs_kernel_clamp(y, -10.0f, 5.0f, N);
+  ASSERT_MEM_EQ(want, y, sizeof(want));
+
+  for (int i = 0; i < N; i++) {
+    want[i] += (x[i] - want[i]) * 0.25f;
+  }
+  ecs_kernel_lerp(y, x, 0.25f, N);
+  ASSERT_MEM_EQ(want, y, sizeof(want));
+
+  // hashes must agree between machines
+  ecs_registry_t *registry = ecs_init();
+  ecs_entity_t vec_component = ecs_component(registry, sizeof(Vec2));
+  for (int i = 0; i < 1000; i++) {
+    ecs_entity_t e = ecs_entity(registry);
+    ecs_attach(registry, e, vec_component);
+    ecs_set(registry, e, vec_component, &(Vec2){(float)i, -(float)i});
+  }
+  uint64_t hash = ecs_world_hash(registry);
+  ecs_kernel_select(ECS_SIMD_SCALAR);
+  ASSERT_EQ(ecs_world_hash(registry), hash);
+  ecs_destroy(registry);
+
+  ecs_kernel_select(ECS_SIMD_AVX2);
+  PASS();
+}
+
+SUITE(kernel) {
+  RUN_TEST1(kernel_matches_scalar, ECS_SIMD_SCALAR);
+  RUN_TEST1(kernel_matches_scalar, ECS_SIMD_SSE);
+  RUN_TEST1(kernel_matches_scalar, ECS_SIMD_AVX2);
 }
 
 GREATEST_MAIN_DEFS();
@@ -471,5 +2705,6 @@ int main(int argc, char *argv[]) {
   RUN_SUITE(map);
   RUN_SUITE(type);
   RUN_SUITE(ecs);
+  RUN_SUITE(kernel);
   GREATEST_MAIN_END();
 }